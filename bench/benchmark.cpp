@@ -2,6 +2,10 @@
 #include <mapbox/geojson.hpp>
 #include <mapbox/geojson_impl.hpp>
 #include <mapbox/geojsonvt.hpp>
+#include <mapbox/geojsonvt/reader.hpp>
+#include <array>
+#include <cstdio>
+#include <random>
 
 #include "util.hpp"
 
@@ -13,6 +17,59 @@ static void ParseGeoJSON(::benchmark::State& state) {
 }
 BENCHMARK(ParseGeoJSON)->Unit(benchmark::kMicrosecond);
 
+// reads the same text straight into projected features, for comparison with ParseGeoJSON
+static void ReadGeoJSON(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    mapbox::geojsonvt::Options options;
+    const double tolerance = (options.tolerance / options.extent) / (1u << options.maxZoom);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mapbox::geojsonvt::detail::parse(json, tolerance));
+    }
+}
+BENCHMARK(ReadGeoJSON)->Unit(benchmark::kMicrosecond);
+
+// projects latitudes one at a time (0) or in a batch (1)
+static void ProjectLatitudes(::benchmark::State& state) {
+    std::vector<double> latitudes(4096);
+    for (std::size_t i = 0; i < latitudes.size(); ++i) {
+        latitudes[i] = -85 + 170.0 * i / latitudes.size();
+    }
+    std::vector<double> y(latitudes.size());
+    for (auto _ : state) {
+        if (state.range(0)) {
+            mapbox::geojsonvt::detail::mercator_y(latitudes.data(), y.data(), latitudes.size());
+        } else {
+            for (std::size_t i = 0; i < latitudes.size(); ++i) {
+                y[i] = mapbox::geojsonvt::detail::mercator_y(latitudes[i]);
+            }
+        }
+        benchmark::DoNotOptimize(y.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * latitudes.size()));
+}
+BENCHMARK(ProjectLatitudes)->Arg(0)->Arg(1);
+
+// simplifies a random walk of a million points, like a long GPS trace
+static void SimplifyLongLine(::benchmark::State& state) {
+    std::mt19937 rng(1);
+    std::normal_distribution<double> step(0, 1e-6);
+    std::vector<mapbox::geojsonvt::detail::vt_point> line;
+    double x = 0.5;
+    double y = 0.5;
+    for (int i = 0; i < 1000000; ++i) {
+        line.emplace_back(x += step(rng), y += step(rng));
+    }
+    mapbox::geojsonvt::Options options;
+    const double tolerance = (options.tolerance / options.extent) / (1u << options.maxZoom);
+    for (auto _ : state) {
+        auto points = line;
+        mapbox::geojsonvt::detail::simplify(points, tolerance);
+        benchmark::DoNotOptimize(points.data());
+    }
+}
+BENCHMARK(SimplifyLongLine)->Unit(benchmark::kMillisecond);
+
 static void GenerateTileIndex(::benchmark::State& state) {
     const std::string json = loadFile("data/countries.geojson");
     const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
@@ -27,6 +84,92 @@ static void GenerateTileIndex(::benchmark::State& state) {
 }
 BENCHMARK(GenerateTileIndex)->Unit(benchmark::kMicrosecond);
 
+static void GenerateTileIndexParallel(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+    options.threads = state.range(0);
+
+    for (auto _ : state) {
+        mapbox::geojsonvt::GeoJSONVT index{ features, options };
+        (void)index;
+    }
+}
+BENCHMARK(GenerateTileIndexParallel)->Unit(benchmark::kMicrosecond)->Arg(2)->Arg(4)->Arg(8);
+
+static void GenerateTileIndexStreaming(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+
+    for (auto _ : state) {
+        mapbox::geojsonvt::GeoJSONVT::Builder builder{ options };
+        for (const auto& feature : features) {
+            builder.add(feature);
+        }
+        benchmark::DoNotOptimize(builder.build());
+    }
+}
+BENCHMARK(GenerateTileIndexStreaming)->Unit(benchmark::kMicrosecond);
+
+// parsing included, through mapbox::geojson::parse (0) or the reader (1)
+static void GenerateTileIndexFromText(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+
+    for (auto _ : state) {
+        if (state.range(0)) {
+            benchmark::DoNotOptimize(mapbox::geojsonvt::parse(json, options));
+        } else {
+            mapbox::geojsonvt::GeoJSONVT index{ mapbox::geojson::parse(json), options };
+            (void)index;
+        }
+    }
+}
+BENCHMARK(GenerateTileIndexFromText)->Unit(benchmark::kMicrosecond)->Arg(0)->Arg(1);
+
+static void UpdateTileIndex(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    for (std::size_t i = 0; i < features.size(); ++i) {
+        features[i].id = uint64_t(i);
+    }
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+    options.updatable = true;
+    mapbox::geojsonvt::GeoJSONVT index{ features, options };
+
+    // replace a single feature, as if it had been edited
+    const mapbox::geojson::feature_collection changed{ features[0] };
+    for (auto _ : state) {
+        index.update(changed);
+    }
+}
+BENCHMARK(UpdateTileIndex)->Unit(benchmark::kMicrosecond);
+
+static void LoadTileIndexSnapshot(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+    const std::string path = "countries.snapshot";
+    mapbox::geojsonvt::GeoJSONVT{ features, options }.save(path);
+
+    for (auto _ : state) {
+        mapbox::geojsonvt::GeoJSONVT::load(path);
+    }
+    std::remove(path.c_str());
+}
+BENCHMARK(LoadTileIndexSnapshot)->Unit(benchmark::kMicrosecond);
+
 static void TraverseTilePyramid(::benchmark::State& state) {
     const std::string json = loadFile("data/countries.geojson");
     const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
@@ -49,6 +192,163 @@ static void TraverseTilePyramid(::benchmark::State& state) {
 }
 BENCHMARK(TraverseTilePyramid)->Unit(benchmark::kMillisecond)->Iterations(3);
 
+static void GetTileHit(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+    mapbox::geojsonvt::GeoJSONVT index{ features, options };
+
+    std::vector<std::array<uint32_t, 3>> tiles;
+    for (const auto& pair : index.getInternalTiles()) {
+        tiles.push_back({ { pair.second.z, pair.second.x, pair.second.y } });
+    }
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const auto& tile = tiles[i++ % tiles.size()];
+        benchmark::DoNotOptimize(index.getTile(tile[0], tile[1], tile[2]));
+    }
+}
+BENCHMARK(GetTileHit);
+
+static void GetTileEmpty(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+    mapbox::geojsonvt::GeoJSONVT index{ features, options };
+
+    // tiles in the middle of the Pacific, whose closest ancestor has no features
+    uint32_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(index.getTile(18, 2000 + i % 1000, 120000 + i / 1000 % 1000));
+        ++i;
+    }
+}
+BENCHMARK(GetTileEmpty);
+
+static void TraverseViewport(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        mapbox::geojsonvt::GeoJSONVT index{ features, options };
+        state.ResumeTiming();
+
+        // a 6x4 tile viewport around western Europe, zooming in
+        for (unsigned z = 8; z < 15; ++z) {
+            const uint32_t x = 127u << (z - 8);
+            const uint32_t y = 85u << (z - 8);
+            if (state.range(0)) {
+                index.getTiles(z, x, y, x + 5, y + 3);
+            } else {
+                for (uint32_t dy = 0; dy < 4; ++dy) {
+                    for (uint32_t dx = 0; dx < 6; ++dx) {
+                        index.getTile(z, x + dx, y + dy);
+                    }
+                }
+            }
+        }
+    }
+}
+BENCHMARK(TraverseViewport)->Unit(benchmark::kMillisecond)->Arg(0)->Arg(1);
+
+static void TraverseViewportCompactSource(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+    options.compactSource = state.range(0);
+
+    std::size_t sourceBytes = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        mapbox::geojsonvt::GeoJSONVT index{ features, options };
+        sourceBytes = 0;
+        for (const auto& pair : index.getMemoryUsage()) {
+            sourceBytes += pair.second.sourceFeatures;
+        }
+        state.ResumeTiming();
+
+        // the viewport TraverseViewport drills down to, unpacking the source features on the way
+        for (unsigned z = 8; z < 15; ++z) {
+            const uint32_t x = 127u << (z - 8);
+            const uint32_t y = 85u << (z - 8);
+            for (uint32_t dy = 0; dy < 4; ++dy) {
+                for (uint32_t dx = 0; dx < 6; ++dx) {
+                    index.getTile(z, x + dx, y + dy);
+                }
+            }
+        }
+    }
+    state.counters["sourceBytes"] = double(sourceBytes);
+}
+BENCHMARK(TraverseViewportCompactSource)->Unit(benchmark::kMillisecond)->Arg(0)->Arg(1);
+
+static void EncodeTiles(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 5;
+    options.indexMaxPoints = 200;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        mapbox::geojsonvt::GeoJSONVT index{ features, options };
+        std::vector<std::array<uint32_t, 3>> tiles;
+        for (const auto& pair : index.getInternalTiles()) {
+            tiles.push_back({ { pair.second.z, pair.second.x, pair.second.y } });
+        }
+        state.ResumeTiming();
+
+        // every tile of a fresh index, none of which has been built yet
+        std::size_t bytes = 0;
+        for (const auto& tile : tiles) {
+            bytes += index.getEncodedTile(tile[0], tile[1], tile[2], "countries").size();
+        }
+        benchmark::DoNotOptimize(bytes);
+    }
+}
+BENCHMARK(EncodeTiles)->Unit(benchmark::kMillisecond);
+
+static void TraverseViewportFlat(::benchmark::State& state) {
+    const std::string json = loadFile("data/countries.geojson");
+    const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
+    mapbox::geojsonvt::Options options;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        mapbox::geojsonvt::GeoJSONVT index{ features, options };
+        state.ResumeTiming();
+
+        // the viewport of TraverseViewport, fetching nested (0) or flat (1) tiles
+        std::size_t size = 0;
+        for (unsigned z = 8; z < 15; ++z) {
+            const uint32_t x = 127u << (z - 8);
+            const uint32_t y = 85u << (z - 8);
+            for (uint32_t dy = 0; dy < 4; ++dy) {
+                for (uint32_t dx = 0; dx < 6; ++dx) {
+                    if (state.range(0))
+                        size += index.getFlatTile(z, x + dx, y + dy).size();
+                    else
+                        size += index.getTile(z, x + dx, y + dy).features.size();
+                }
+            }
+        }
+        benchmark::DoNotOptimize(size);
+    }
+}
+BENCHMARK(TraverseViewportFlat)->Unit(benchmark::kMillisecond)->Arg(0)->Arg(1);
+
 static void LargeGeoJSONParse(::benchmark::State& state) {
     const std::string json = loadFile("test/fixtures/points.geojson");
     for (auto _ : state) {
@@ -57,6 +357,16 @@ static void LargeGeoJSONParse(::benchmark::State& state) {
 }
 BENCHMARK(LargeGeoJSONParse)->Unit(benchmark::kMicrosecond);
 
+static void LargeGeoJSONRead(::benchmark::State& state) {
+    const std::string json = loadFile("test/fixtures/points.geojson");
+    mapbox::geojsonvt::Options options;
+    const double tolerance = (options.tolerance / options.extent) / (1u << options.maxZoom);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(mapbox::geojsonvt::detail::parse(json, tolerance));
+    }
+}
+BENCHMARK(LargeGeoJSONRead)->Unit(benchmark::kMicrosecond);
+
 static void LargeGeoJSONTileIndex(::benchmark::State& state) {
     const std::string json = loadFile("test/fixtures/points.geojson");
     const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
@@ -71,12 +381,20 @@ static void LargeGeoJSONGetTile(::benchmark::State& state) {
     const std::string json = loadFile("test/fixtures/points.geojson");
     const auto features = mapbox::geojson::parse(json).get<mapbox::geojson::feature_collection>();
     mapbox::geojsonvt::Options options;
+    // copying (0) or sharing (1) the properties of the output features
+    options.sharedProperties = state.range(0);
     mapbox::geojsonvt::GeoJSONVT index{ features, options };
     for (auto _ : state) {
         index.getTile(12, 1171, 1566);
     }
 }
-BENCHMARK(LargeGeoJSONGetTile)->Unit(benchmark::kMillisecond)->Iterations(1)->Repetitions(9)->ReportAggregatesOnly(true);
+BENCHMARK(LargeGeoJSONGetTile)
+    ->Unit(benchmark::kMillisecond)
+    ->Iterations(1)
+    ->Repetitions(9)
+    ->ReportAggregatesOnly(true)
+    ->Arg(0)
+    ->Arg(1);
 
 static void LargeGeoJSONToTile(::benchmark::State& state) {
     const std::string json = loadFile("data/countries.geojson");
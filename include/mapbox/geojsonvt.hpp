@@ -1,16 +1,33 @@
 #pragma once
 
 #include <mapbox/geojsonvt/convert.hpp>
+#include <mapbox/geojsonvt/mvt.hpp>
+#include <mapbox/geojsonvt/snapshot.hpp>
 #include <mapbox/geojsonvt/tile.hpp>
+#include <mapbox/geojsonvt/tile_store.hpp>
 #include <mapbox/geojsonvt/types.hpp>
 #include <mapbox/geojsonvt/wrap.hpp>
 
 #include <mapbox/feature.hpp>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <iterator>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 namespace mapbox {
 namespace geojsonvt {
@@ -45,6 +62,21 @@ struct TileOptions {
 
     // enable line metrics tracking for LineString/MultiLineString features
     bool lineMetrics = false;
+
+    // share the property maps of the source features with the output tiles through
+    // Tile::properties, leaving the properties of Tile features empty, instead of copying them
+    // into every tile
+    bool sharedProperties = false;
+
+    // keys of the feature properties to keep, leaving out the others when features are converted
+    // (all of them are kept if there are none)
+    std::unordered_set<std::string> propertyKeys;
+
+    // decides which of the remaining properties to keep, if set
+    std::function<bool(const std::string& key, const mapbox::feature::value& value)> propertyFilter;
+
+    // keep only properties with number and boolean values, dropping strings and nested values
+    bool numericProperties = false;
 };
 
 struct Options : TileOptions {
@@ -59,9 +91,39 @@ struct Options : TileOptions {
 
     // whether to generate feature ids, overriding existing ids  
     bool generateId = false;
+
+    // whether to keep the source features, so that the index can be changed with update()
+    bool updatable = false;
+
+    // number of threads used to convert the features and build the initial tile index (a
+    // propertyFilter is then called from several threads at once)
+    uint32_t threads = 1;
+
+    // approximate memory budget for tiles that getTile generates below indexMaxZoom; the least
+    // recently used ones are evicted once it's exceeded (0 means no limit). With a budget, a
+    // reference returned by getTile stays valid until the same thread calls getTile again or exits.
+    uint64_t maxCacheBytes = 0;
+
+    // An approximate mode that trades precision for memory: tiles keep the source features they
+    // can be drilled down from packed, in less than half the memory per point, but the tiles
+    // drilled down from them aren't exactly the ones generated without it, as about one point in
+    // ten thousand rounds to the next pixel. Coordinates are kept to 2^-30 of the tile, and only
+    // tiles where that's within a sixteenth of a pixel at maxZoom are packed (with the default
+    // extent, tiles at most 14 levels above it), so with a high maxZoom the tiles near the top of
+    // the index, which hold most of the source geometry, aren't packed and little is saved.
+    // Clipping, simplification and the transform into tile coordinates still work on the
+    // unpacked features.
+    bool compactSource = false;
 };
 
 const Tile empty_tile{};
+const FlatTile empty_flat_tile{};
+
+// The tiles of an index by their toID, as getInternalTiles returns them. This used to be a
+// std::unordered_map<uint64_t, detail::InternalTile>, and it reads the same way: find, at, count,
+// size, empty and iteration over pairs of ids and tiles. Unlike the map, it has no bucket
+// interface and can't be copied.
+using InternalTiles = detail::tile_store;
 
 inline uint64_t toID(uint8_t z, uint32_t x, uint32_t y) {
     return (((1ull << z) * y + x) * 32) + z;
@@ -78,17 +140,20 @@ inline const Tile geoJSONToTile(const geojson& geojson_,
     const auto features_ = geojson::visit(geojson_, ToFeatureCollection{});
     auto z2 = 1u << z;
     auto tolerance = (options.tolerance / options.extent) / z2;
-    auto features = detail::convert(features_, tolerance, false);
+    const detail::property_filter filter{ options.propertyKeys, options.propertyFilter, options.numericProperties };
+    auto features = detail::convert(features_, tolerance, false, 0, &filter);
     if (wrap) {
-        features = detail::wrap(features, double(options.buffer) / options.extent, options.lineMetrics);
+        features = detail::wrap(std::move(features), double(options.buffer) / options.extent, options.lineMetrics);
     }
     if (clip || options.lineMetrics) {
         const double p = double(options.buffer) / options.extent;
 
-        const auto left = detail::clip<0>(features, (x - p) / z2, (x + 1 + p) / z2, -1, 2, options.lineMetrics);
-        features = detail::clip<1>(left, (y - p) / z2, (y + 1 + p) / z2, -1, 2, options.lineMetrics);
+        auto left = detail::clip<0>(std::move(features), (x - p) / z2, (x + 1 + p) / z2, -1, 2, options.lineMetrics);
+        features = detail::clip<1>(std::move(left), (y - p) / z2, (y + 1 + p) / z2, -1, 2, options.lineMetrics);
     }
-    return detail::InternalTile({ features, z, x, y, options.extent, tolerance, options.lineMetrics }).tile;
+    return detail::InternalTile({ features, z, x, y, options.extent, tolerance, options.lineMetrics,
+                                  options.sharedProperties })
+        .getTile();
 }
 
 class GeoJSONVT {
@@ -101,160 +166,1050 @@ public:
 
         const uint32_t z2 = 1u << options.maxZoom;
 
-        auto converted = detail::convert(features_, (options.tolerance / options.extent) / z2, options.generateId);
-        auto features = detail::wrap(converted, double(options.buffer) / options.extent, options.lineMetrics);
-
-        splitTile(features, 0, 0, 0);
+        const detail::property_filter filter{ options.propertyKeys, options.propertyFilter, options.numericProperties };
+        auto converted = detail::convert(features_, (options.tolerance / options.extent) / z2, options.generateId, 0,
+                                         &filter, options.threads);
+        generate(std::move(converted), features_.size());
     }
 
     GeoJSONVT(const geojson& geojson_, const Options& options_ = Options())
         : GeoJSONVT(geojson::visit(geojson_, ToFeatureCollection{}), options_) {
     }
 
+    // Builds an index from features that are added one at a time, such as the ones a parser
+    // produces as it reads its input. Each feature is projected as soon as it's added, so the
+    // source features never have to be in memory all at once; the index is the same as one
+    // built from a collection of the features in the order they were added.
+    class Builder {
+    public:
+        explicit Builder(const Options& options_ = Options())
+            : options(options_), tolerance((options.tolerance / options.extent) / (1u << options.maxZoom)) {
+        }
+
+        Builder& add(const mapbox::feature::feature<double>& feature) {
+            const detail::property_filter filter{ options.propertyKeys, options.propertyFilter,
+                                                  options.numericProperties };
+            const auto id = options.generateId ? mapbox::feature::identifier(uint64_t(count)) : feature.id;
+            features.push_back(detail::convert(feature, tolerance, id, &filter));
+            ++count;
+            return *this;
+        }
+
+        // adds a feature that's projected already, with this builder's tolerance and property
+        // filter (as <mapbox/geojsonvt/reader.hpp> does); only its id is still generated here
+        Builder& add(detail::vt_feature feature) {
+            if (options.generateId)
+                feature.id = mapbox::feature::identifier(uint64_t(count));
+            features.push_back(std::move(feature));
+            ++count;
+            return *this;
+        }
+
+        template <class InputIterator>
+        Builder& add(InputIterator first, const InputIterator last) {
+            for (; first != last; ++first) {
+                add(*first);
+            }
+            return *this;
+        }
+
+        // generates the index from the features added so far; the builder is left empty
+        std::unique_ptr<GeoJSONVT> build() {
+            std::unique_ptr<GeoJSONVT> index(new GeoJSONVT(options, std::move(features), count));
+            features = {};
+            count = 0;
+            return index;
+        }
+
+    private:
+        const Options options;
+        const double tolerance;
+        detail::vt_features features;
+        uint64_t count = 0;
+    };
+
+    // stops pre-warming and waits for it
+    ~GeoJSONVT() {
+        stopping = true;
+        std::lock_guard<std::mutex> lock(prewarmMutex);
+        for (const auto& future : prewarming) {
+            future.wait();
+        }
+    }
+
+    // written under the index lock; only read them while no other thread is calling getTile
     std::map<uint8_t, uint32_t> stats;
     uint32_t total = 0;
 
-    const Tile& getTile(const uint8_t z, const uint32_t x_, const uint32_t y) {
+    // Safe to call from several threads at once: cache hits only take a shared lock, and
+    // drill-downs from different parent tiles run in parallel. Requests that fall under a tile
+    // which is being split by another thread wait for that drill-down to finish.
+    const Tile& getTile(const uint8_t z, const uint32_t x, const uint32_t y) {
+        return withTile(z, x, y, [](const detail::InternalTile* tile) -> const Tile& {
+            return tile ? tile->getTile() : empty_tile;
+        });
+    }
+
+    // The same features as getTile, in the flat arrays they're stored in. Doesn't build the Tile
+    // getTile returns. A tile only keeps both forms once both have been requested.
+    const FlatTile& getFlatTile(const uint8_t z, const uint32_t x, const uint32_t y) {
+        return withTile(z, x, y, [](const detail::InternalTile* tile) -> const FlatTile& {
+            return tile ? tile->getFlatTile() : empty_flat_tile;
+        });
+    }
+
+    // The tile encoded as a Mapbox Vector Tile with a single layer of the given name; empty if the
+    // tile has no features. It's written straight from the tile's features, without building the
+    // Tile getTile returns, and can be called concurrently like getTile.
+    std::string getEncodedTile(const uint8_t z, const uint32_t x, const uint32_t y, const std::string& layer) {
+        return withTile(z, x, y, [&](const detail::InternalTile* tile) {
+            if (!tile)
+                return std::string();
+            detail::mvt_writer writer;
+            return writer.encode(*tile, layer);
+        });
+    }
+
+    // Returns the tiles from minX, minY to maxX, maxY (inclusive) at zoom z, row by row. Tiles that
+    // need to be generated are drilled down to at once from each of their closest ancestors, so
+    // the ancestors they share are only clipped once. Coordinates aren't wrapped. Can be called
+    // concurrently with getTile; with a cache budget, the returned tiles stay valid until the same
+    // thread calls getTile or getTiles again.
+    std::vector<const Tile*> getTiles(const uint8_t z,
+                                      const uint32_t minX,
+                                      const uint32_t minY,
+                                      const uint32_t maxX,
+                                      const uint32_t maxY) {
 
         if (z > options.maxZoom)
             throw std::runtime_error("Requested zoom higher than maxZoom: " + std::to_string(z));
 
         const uint32_t z2 = 1u << z;
-        const uint32_t x = ((x_ % z2) + z2) % z2; // wrap tile x coordinate
-        const uint64_t id = toID(z, x, y);
+        if (minX > maxX || minY > maxY || maxX >= z2 || maxY >= z2)
+            throw std::runtime_error("Invalid tile range");
 
-        auto it = tiles.find(id);
-        if (it != tiles.end())
-            return it->second.tile;
+        const uint64_t width = maxX - minX + 1;
+        std::vector<const Tile*> result(width * (maxY - minY + 1));
 
-        it = findParent(z, x, y);
+        std::vector<uint64_t> ids;
+        if (options.maxCacheBytes) {
+            ids.reserve(result.size());
+            for (uint32_t y = minY; y <= maxY; ++y) {
+                for (uint32_t x = minX; x <= maxX; ++x) {
+                    ids.push_back(toID(z, x, y));
+                }
+            }
+        }
 
-        if (it == tiles.end())
-            throw std::runtime_error("Parent tile not found");
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
+        touch(ids);
 
-        // if we found a parent tile containing the original geometry, we can drill down from it
-        const auto& parent = it->second;
+        for (std::size_t i = 0; i < result.size();) {
+            const uint32_t x = minX + i % width;
+            const uint32_t y = minY + i / width;
 
-        // drill down parent tile up to the requested one
-        splitTile(parent.source_features, parent.z, parent.x, parent.y, z, x, y);
+            auto it = tiles.find(toID(z, x, y));
+            if (it != tiles.end()) {
+                result[i++] = &it->second.getTile();
+                continue;
+            }
 
-        it = tiles.find(id);
-        if (it != tiles.end())
-            return it->second.tile;
+            if (isSplitting(z, x, y)) {
+                drilled.wait(lock);
+                continue;
+            }
 
-        it = findParent(z, x, y);
-        if (it == tiles.end())
-            throw std::runtime_error("Parent tile not found");
+            it = findParent(z, x, y);
+
+            if (it == tiles.end())
+                throw std::runtime_error("Parent tile not found");
+
+            auto& parent = it->second;
+            if (!parent.hasSource()) {
+                result[i++] = &empty_tile;
+                continue;
+            }
+
+            // the requested tiles below this parent; the ones before this one have been found
+            // already, so they're only drilled into again where they share its ancestors
+            const uint8_t d = z - parent.z;
+            drill(lock, parent, { z, std::max(minX, parent.x << d), std::max(minY, parent.y << d),
+                                  std::min(maxX, ((parent.x + 1) << d) - 1),
+                                  std::min(maxY, ((parent.y + 1) << d) - 1) });
+        }
+
+        if (options.maxCacheBytes)
+            evict(0);
+
+        return result;
+    }
+
+    // Generates the tiles from minZoom to maxZoom that overlap the given bounds (in longitude and
+    // latitude) on Options::threads background threads, so that later getTile calls find them
+    // ready. Returns a future that is ready once they're all generated, and that rethrows any
+    // error. With a cache budget, only as many of them stay in the index as the budget allows.
+    // update and save must not be called until it's ready.
+    std::shared_future<void> prewarm(const uint8_t minZoom,
+                                     const uint8_t maxZoom,
+                                     const mapbox::geometry::box<double>& bounds = { { -180, -90 },
+                                                                                     { 180, 90 } }) {
+        if (minZoom > maxZoom || maxZoom > options.maxZoom)
+            throw std::runtime_error("Invalid zoom range");
+
+        const auto min = detail::project{ 0 }(mapbox::geometry::point<double>(bounds.min.x, bounds.max.y));
+        const auto max = detail::project{ 0 }(mapbox::geometry::point<double>(bounds.max.x, bounds.min.y));
+
+        auto future = std::async(std::launch::async, [this, minZoom, maxZoom, min, max] {
+            const uint32_t workers = std::max(options.threads, 1u);
+            for (uint8_t z = minZoom; z <= maxZoom && !stopping; ++z) {
+                const double z2 = 1u << z;
+                const auto tile = [&](const double k) {
+                    return static_cast<uint32_t>(std::min(std::max(std::floor(k * z2), 0.0), z2 - 1));
+                };
+                const uint32_t minX = tile(min.x);
+                const uint32_t minY = tile(min.y);
+                const uint32_t maxX = tile(max.x);
+                const uint32_t maxY = tile(max.y);
+
+                // pairs of rows, so that sibling tiles are drilled down to together
+                std::atomic<uint32_t> next{ minY & ~1u };
+                const auto work = [&] {
+                    while (!stopping) {
+                        const uint32_t y = next.fetch_add(2);
+                        if (y > maxY)
+                            break;
+                        getTiles(z, minX, std::max(y, minY), maxX, std::min(y + 1, maxY));
+                    }
+                    unpin();
+                };
+
+                std::vector<std::future<void>> helpers;
+                for (uint32_t i = 1; i < workers; ++i) {
+                    helpers.push_back(std::async(std::launch::async, work));
+                }
+                work();
+                for (auto& helper : helpers) {
+                    helper.get();
+                }
+            }
+        }).share();
+
+        std::lock_guard<std::mutex> lock(prewarmMutex);
+        prewarming.push_back(future);
+        return future;
+    }
+
+    // Replaces the features that have the same ids as the given ones, adds the others (with new
+    // ids if generateId is set), and removes the features with the given ids. Changed features
+    // come after the others in the tiles. Only tiles that the changed features overlap are
+    // generated again, and the references getTile returned for them become invalid.
+    // Requires Options::updatable. Not synchronized with concurrent getTile calls.
+    void update(const feature_collection& features,
+                const std::vector<mapbox::feature::identifier>& removed = {}) {
+        if (!options.updatable)
+            throw std::runtime_error("Index was not created with Options::updatable");
+
+        if (mappedSource) {
+            source = snapshot->readFeatures(mappedSource);
+            mappedSource = 0;
+        }
+
+        const uint32_t z2 = 1u << options.maxZoom;
+
+        const detail::property_filter filter{ options.propertyKeys, options.propertyFilter, options.numericProperties };
+        auto converted = detail::convert(features, (options.tolerance / options.extent) / z2, options.generateId,
+                                         nextId, &filter, options.threads);
+        auto added = detail::wrap(std::move(converted), double(options.buffer) / options.extent, options.lineMetrics);
+        if (options.generateId)
+            nextId += features.size();
 
-        return empty_tile;
+        std::unordered_set<mapbox::feature::identifier, detail::identifier_hash> ids(removed.begin(), removed.end());
+        if (!options.generateId) {
+            for (const auto& feature : features) {
+                if (!feature.id.is<detail::null_value>())
+                    ids.insert(feature.id);
+            }
+        }
+
+        // the old versions of removed and replaced features, and the new ones
+        detail::vt_features changed;
+        const auto kept = std::stable_partition(source.begin(), source.end(), [&](const auto& feature) {
+            return !ids.count(feature.id);
+        });
+        changed.insert(changed.end(), std::make_move_iterator(kept), std::make_move_iterator(source.end()));
+        source.erase(kept, source.end());
+        source.insert(source.end(), added.begin(), added.end());
+        changed.insert(changed.end(), std::make_move_iterator(added.begin()), std::make_move_iterator(added.end()));
+
+        if (changed.empty())
+            return;
+
+        auto root = source;
+        updateTile(root, changed, 0, 0, 0);
+
+        if (options.maxCacheBytes)
+            evict(0);
+    }
+
+    // Writes the index to a binary snapshot that load() reads back without building it again. The
+    // tiles are written as they are, without transforming or building any of them for good.
+    // Not synchronized with concurrent getTile calls.
+    void save(const std::string& path) const {
+        detail::snapshot_writer writer;
+        writer.sqTolerances = sqTolerances;
+        writer.snapshot = snapshot.get();
+        writer.writeHeader();
+        writer.write(options.tolerance);
+        writer.write(options.extent);
+        writer.write(options.buffer);
+        writer.write(uint8_t(options.lineMetrics));
+        writer.write(options.maxZoom);
+        writer.write(options.indexMaxZoom);
+        writer.write(options.indexMaxPoints);
+        writer.write(uint8_t(options.generateId));
+        writer.write(uint8_t(options.updatable));
+        writer.write(nextId);
+
+        const std::size_t start = writer.buffer.size();
+        writer.write(uint64_t(tiles.size()));
+        for (const auto& pair : tiles) {
+            writer.write(pair.second);
+        }
+        writer.write(source, mappedSource);
+        writer.insertTables(start);
+
+        std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        out.write(writer.buffer.data(), static_cast<std::streamsize>(writer.buffer.size()));
+        if (!out)
+            throw std::runtime_error("Error writing file " + path);
+    }
+
+    // Reads an index written by save(), memory-mapping the file where possible. Only the output
+    // tiles are read up front; the file stays mapped for as long as the index, and the source
+    // features are read from it when tiles are drilled down from (or on the first update), so a
+    // corrupt file may only be found out then. The options the index was built with are restored
+    // from the snapshot; threads, maxCacheBytes, sharedProperties, compactSource and the property
+    // filters that update() applies are taken from the given ones.
+    static std::unique_ptr<GeoJSONVT> load(const std::string& path, const Options& options_ = Options()) {
+        auto snapshot = std::make_unique<detail::mapped_snapshot>(path);
+        detail::snapshot_reader reader(*snapshot);
+        reader.readHeader();
+
+        Options options = options_;
+        options.tolerance = reader.read<double>();
+        options.extent = reader.read<uint16_t>();
+        options.buffer = reader.read<uint16_t>();
+        options.lineMetrics = reader.read<uint8_t>();
+        options.maxZoom = reader.read<uint8_t>();
+        options.indexMaxZoom = reader.read<uint8_t>();
+        options.indexMaxPoints = reader.read<uint32_t>();
+        options.generateId = reader.read<uint8_t>();
+        options.updatable = reader.read<uint8_t>();
+
+        return std::unique_ptr<GeoJSONVT>(new GeoJSONVT(options, std::move(snapshot), reader));
     }
 
-    const std::unordered_map<uint64_t, detail::InternalTile>& getInternalTiles() const {
+    // Estimated heap memory held by the generated tiles of each zoom level. Geometry shared
+    // between tiles is counted once, at the lowest zoom that refers to it. Not synchronized with
+    // concurrent getTile calls.
+    std::map<uint8_t, MemoryUsage> getMemoryUsage() const {
+        std::vector<const detail::InternalTile*> sorted;
+        sorted.reserve(tiles.size());
+        for (const auto& pair : tiles) {
+            sorted.push_back(&pair.second);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) {
+            return a->z < b->z;
+        });
+
+        std::map<uint8_t, MemoryUsage> usage;
+        std::unordered_set<const detail::vt_geometry*> counted;
+        for (const auto* tile : sorted) {
+            usage[tile->z] += detail::estimateMemory(*tile, &counted);
+        }
+        return usage;
+    }
+
+    // Estimated heap memory held by a tile, counting geometry it shares with other tiles in full;
+    // nothing if it hasn't been generated. Not synchronized with concurrent getTile calls.
+    MemoryUsage getMemoryUsage(const uint8_t z, const uint32_t x, const uint32_t y) const {
+        const auto it = tiles.find(toID(z, x, y));
+        if (it == tiles.end())
+            return {};
+        return detail::estimateMemory(it->second);
+    }
+
+    // Not synchronized with concurrent getTile calls.
+    const InternalTiles& getInternalTiles() const {
         return tiles;
     }
 
 private:
-    std::unordered_map<uint64_t, detail::InternalTile> tiles;
+    GeoJSONVT(const Options& options_, detail::vt_features converted, const uint64_t count) : options(options_) {
+        generate(std::move(converted), count);
+    }
+
+    // generates the top of the index from count converted source features
+    void generate(detail::vt_features converted, const uint64_t count) {
+        auto features = detail::wrap(std::move(converted), double(options.buffer) / options.extent, options.lineMetrics);
+
+        if (options.updatable) {
+            source = features;
+            nextId = count;
+        }
 
-    std::unordered_map<uint64_t, detail::InternalTile>::iterator
+        spareThreads = options.threads > 1 ? options.threads - 1 : 0;
+        splitTile(features, true, 0, 0, 0);
+    }
+
+    // tiles loaded from a snapshot stay out of the cache, as the tiles above them may not have
+    // kept the source features needed to generate them again
+    GeoJSONVT(const Options& options_,
+              std::unique_ptr<detail::mapped_snapshot> snapshot_,
+              detail::snapshot_reader& reader)
+        : options(options_) {
+        nextId = reader.read<uint64_t>();
+        snapshot_->readTables(reader);
+
+        const auto count = reader.read<uint64_t>();
+        for (uint64_t i = 0; i < count; ++i) {
+            const auto z = reader.read<uint8_t>();
+            const auto x = reader.read<uint32_t>();
+            const auto y = reader.read<uint32_t>();
+            const auto bbox = reader.readBox();
+            auto flat = reader.readFlatTile();
+
+            detail::InternalTile tile{ std::move(flat), bbox, z, x, y, options.extent, tileTolerance(z),
+                                       options.lineMetrics, options.sharedProperties };
+            tile.mapped_source = reader.skipFeatures();
+            if (z > options.maxZoom || !tiles.emplace(toID(z, x, y), std::move(tile)).second)
+                throw std::runtime_error("Invalid snapshot tile");
+            stats[z] = (stats.count(z) ? stats[z] + 1 : 1);
+            total++;
+        }
+
+        mappedSource = reader.skipFeatures();
+        if (!reader.done())
+            throw std::runtime_error("Invalid snapshot");
+        snapshot = std::move(snapshot_);
+    }
+
+    struct TileCoord {
+        uint8_t z;
+        uint32_t x;
+        uint32_t y;
+    };
+
+    // the tiles at zoom z from minX, minY to maxX, maxY
+    struct TileRange {
+        uint8_t z;
+        uint32_t minX;
+        uint32_t minY;
+        uint32_t maxX;
+        uint32_t maxY;
+    };
+
+    struct CacheEntry {
+        TileCoord coord;
+        std::size_t bytes;
+        std::list<uint64_t>::iterator position;
+        // whether bytes counts the built tile, and the flat features kept next to it
+        bool built;
+        bool flatKept;
+    };
+
+    detail::tile_store tiles;
+
+    // guards tiles, stats, total and splitting
+    std::shared_timed_mutex mutex;
+    // notified whenever a drill-down finishes
+    std::condition_variable_any drilled;
+    // tiles whose source features are currently being split by a drill-down
+    std::vector<TileCoord> splitting;
+    // threads still available for splitting subtrees in parallel during the initial build
+    std::atomic<uint32_t> spareThreads{ 0 };
+
+    // all features, with Options::updatable
+    detail::vt_features source;
+    // the snapshot the index was loaded from, if it was, which the source features that tiles and
+    // the index have left there are read from
+    std::unique_ptr<const detail::mapped_snapshot> snapshot;
+    uint64_t mappedSource = 0;
+    // the squared simplification tolerance of each zoom level, which packed source features
+    // are stored for
+    const std::vector<double> sqTolerances = squaredTolerances();
+    // the next id to generate, with Options::updatable and generateId
+    uint64_t nextId = 0;
+
+    // tiles below indexMaxZoom that count towards maxCacheBytes, most recently used first
+    std::unordered_map<uint64_t, CacheEntry> cache;
+    std::list<uint64_t> lru;
+    uint64_t cacheBytes = 0;
+    // lets cache hits under the shared lock update lru
+    std::mutex lruMutex;
+
+    // the tiles each thread got from its last getTile or getTiles call, which must not be evicted;
+    // shared with the threads, which remove their own entry when they exit
+    struct pin_table {
+        std::mutex mutex;
+        std::unordered_map<std::thread::id, std::vector<uint64_t>> pinned;
+    };
+    const std::shared_ptr<pin_table> pins = std::make_shared<pin_table>();
+
+    // unpins a thread from the indexes it got tiles from, when it exits
+    struct thread_pins {
+        std::vector<std::weak_ptr<pin_table>> tables;
+
+        ~thread_pins() {
+            const auto id = std::this_thread::get_id();
+            for (const auto& weak : tables) {
+                if (const auto table = weak.lock()) {
+                    std::lock_guard<std::mutex> lock(table->mutex);
+                    table->pinned.erase(id);
+                }
+            }
+        }
+    };
+
+    // background pre-warming, which the destructor stops and waits for
+    std::vector<std::shared_future<void>> prewarming;
+    std::mutex prewarmMutex;
+    std::atomic<bool> stopping{ false };
+
+    // mark a tile as used and returned to the calling thread (0 for none)
+    void touch(const uint64_t id) {
+        if (!options.maxCacheBytes)
+            return;
+        pin({ id });
+        std::lock_guard<std::mutex> lock(lruMutex);
+        bump(id);
+    }
+
+    // mark several tiles as used and returned to the calling thread
+    void touch(const std::vector<uint64_t>& ids) {
+        if (!options.maxCacheBytes)
+            return;
+        pin(ids);
+        std::lock_guard<std::mutex> lock(lruMutex);
+        for (const auto id : ids) {
+            bump(id);
+        }
+    }
+
+    // replace the tiles pinned for the calling thread; its first pin registers it to be unpinned
+    // when it exits, so the table only holds threads that are still running
+    void pin(const std::vector<uint64_t>& ids) {
+        bool added;
+        {
+            std::lock_guard<std::mutex> lock(pins->mutex);
+            auto& pinned = pins->pinned[std::this_thread::get_id()];
+            added = pinned.empty();
+            pinned = ids;
+        }
+        if (added) {
+            thread_local thread_pins exiting;
+            auto& tables = exiting.tables;
+            tables.erase(std::remove_if(tables.begin(), tables.end(),
+                                        [&](const std::weak_ptr<pin_table>& table) {
+                                            return table.expired() || table.lock() == pins;
+                                        }),
+                         tables.end());
+            tables.push_back(pins);
+        }
+    }
+
+    // forget the tiles a thread got, when it's done with them
+    void unpin() {
+        if (!options.maxCacheBytes)
+            return;
+        std::lock_guard<std::mutex> lock(pins->mutex);
+        pins->pinned.erase(std::this_thread::get_id());
+    }
+
+    void bump(const uint64_t id) {
+        const auto it = cache.find(id);
+        if (it != cache.end())
+            lru.splice(lru.begin(), lru, it->second.position);
+    }
+
+    // called with pins->mutex held
+    bool isPinned(const uint64_t id) const {
+        for (const auto& pair : pins->pinned) {
+            if (std::find(pair.second.begin(), pair.second.end(), id) != pair.second.end())
+                return true;
+        }
+        return false;
+    }
+
+    // start accounting for a tile below indexMaxZoom in the cache, if it isn't yet
+    void cacheTile(const TileCoord coord) {
+        const uint64_t id = toID(coord.z, coord.x, coord.y);
+        if (coord.z <= options.indexMaxZoom || cache.count(id))
+            return;
+        const auto it = tiles.find(id);
+        if (it == tiles.end())
+            return;
+        const std::size_t bytes = detail::estimateSize(it->second);
+        lru.push_front(id);
+        cache.emplace(id, CacheEntry{ coord, bytes, lru.begin(), it->second.isBuilt(), it->second.isFlatKept() });
+        cacheBytes += bytes;
+    }
+
+    // count the tiles built or flattened since they were cached again, now that they hold property
+    // copies or both forms of their features
+    void recountBuilt() {
+        for (auto& pair : cache) {
+            auto& entry = pair.second;
+            if (entry.built && entry.flatKept)
+                continue;
+            const auto& tile = tiles.at(pair.first);
+            const bool built = tile.isBuilt();
+            const bool flatKept = tile.isFlatKept();
+            if (built == entry.built && flatKept == entry.flatKept)
+                continue;
+            const std::size_t bytes = detail::estimateSize(tile);
+            cacheBytes = cacheBytes - entry.bytes + bytes;
+            entry.bytes = bytes;
+            entry.built = built;
+            entry.flatKept = flatKept;
+        }
+    }
+
+    // start accounting for the tiles a drill-down from parent to the target tiles has created
+    void cacheDrilled(const detail::InternalTile& parent, const TileRange& target) {
+        for (uint8_t z0 = parent.z + 1; z0 <= target.z; ++z0) {
+            const uint8_t d = target.z - z0;
+            for (uint32_t y0 = (target.minY >> d) & ~1u; y0 <= ((target.maxY >> d) | 1u); ++y0) {
+                for (uint32_t x0 = (target.minX >> d) & ~1u; x0 <= ((target.maxX >> d) | 1u); ++x0) {
+                    cacheTile({ z0, x0, y0 });
+                }
+            }
+        }
+    }
+
+    void removeTile(const TileCoord coord) {
+        const uint64_t id = toID(coord.z, coord.x, coord.y);
+        tiles.erase(id);
+        if (--stats[coord.z] == 0)
+            stats.erase(coord.z);
+        total--;
+
+        const auto entry = cache.find(id);
+        if (entry != cache.end()) {
+            cacheBytes -= entry->second.bytes;
+            lru.erase(entry->second.position);
+            cache.erase(entry);
+        }
+    }
+
+    // evict least recently used tiles until the cache fits its budget again
+    void evict(const uint64_t keep) {
+        recountBuilt();
+        // threads that exit unpin themselves without the index lock
+        std::lock_guard<std::mutex> lock(pins->mutex);
+        auto it = lru.end();
+        while (cacheBytes > options.maxCacheBytes && it != lru.begin()) {
+            --it;
+            const uint64_t id = *it;
+            const auto entry = cache.find(id);
+            const auto& coord = entry->second.coord;
+            if (id == keep || isPinned(id) || isSplitting(coord.z, coord.x, coord.y))
+                continue;
+
+            ++it;
+            removeTile(coord);
+        }
+    }
+
+    bool reserveThread() {
+        uint32_t n = spareThreads.load();
+        while (n > 0 && !spareThreads.compare_exchange_weak(n, n - 1)) {
+        }
+        return n > 0;
+    }
+
+    // run a and b, b on another thread if one is spare; they must touch disjoint subtrees
+    template <class A, class B>
+    void forkJoin(const A& a, const B& b) {
+        if (!reserveThread()) {
+            a();
+            b();
+            return;
+        }
+        auto future = std::async(std::launch::async, [&] {
+            struct Release {
+                std::atomic<uint32_t>& n;
+                ~Release() {
+                    ++n;
+                }
+            } release{ spareThreads };
+            b();
+        });
+        a();
+        future.get();
+    }
+
+    bool isSplitting(const uint8_t z, const uint32_t x, const uint32_t y) const {
+        for (const auto& s : splitting) {
+            if (s.z <= z && (x >> (z - s.z)) == s.x && (y >> (z - s.z)) == s.y)
+                return true;
+        }
+        return false;
+    }
+
+    void finishSplit(const detail::InternalTile& parent) {
+        splitting.erase(std::find_if(splitting.begin(), splitting.end(), [&](const TileCoord& s) {
+            return s.z == parent.z && s.x == parent.x && s.y == parent.y;
+        }));
+        drilled.notify_all();
+    }
+
+    // find or generate a tile, and pass it to f while the lock is held (nullptr if it's empty)
+    template <class F>
+    auto withTile(const uint8_t z, const uint32_t x_, const uint32_t y, const F& f)
+        -> decltype(f(nullptr)) {
+
+        if (z > options.maxZoom)
+            throw std::runtime_error("Requested zoom higher than maxZoom: " + std::to_string(z));
+
+        const uint32_t z2 = 1u << z;
+        const uint32_t x = ((x_ % z2) + z2) % z2; // wrap tile x coordinate
+        const uint64_t id = toID(z, x, y);
+
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(mutex);
+            auto it = tiles.find(id);
+            if (it != tiles.end()) {
+                touch(id);
+                return f(&it->second);
+            }
+        }
+
+        std::unique_lock<std::shared_timed_mutex> lock(mutex);
+
+        while (true) {
+            auto it = tiles.find(id);
+            if (it != tiles.end()) {
+                touch(id);
+                return f(&it->second);
+            }
+
+            // another thread is drilling down through an ancestor of this tile
+            if (isSplitting(z, x, y)) {
+                drilled.wait(lock);
+                continue;
+            }
+
+            it = findParent(z, x, y);
+
+            if (it == tiles.end())
+                throw std::runtime_error("Parent tile not found");
+
+            // if we found a parent tile containing the original geometry, we can drill down from it
+            auto& parent = it->second;
+            if (!parent.hasSource()) {
+                touch(0);
+                return f(nullptr);
+            }
+
+            drill(lock, parent, { z, x, y, x, y });
+            if (options.maxCacheBytes)
+                evict(id);
+
+            it = tiles.find(id);
+            if (it != tiles.end()) {
+                touch(id);
+                return f(&it->second);
+            }
+
+            touch(0);
+            return f(nullptr);
+        }
+    }
+
+    // drill down from a parent tile to the target tiles below it, without holding the lock
+    void drill(std::unique_lock<std::shared_timed_mutex>& lock,
+               detail::InternalTile& parent,
+               const TileRange& target) {
+        splitting.push_back({ parent.z, parent.x, parent.y });
+
+        // with a cache budget, drilled tiles keep their source features, so that any of them
+        // can be evicted and generated again from the closest remaining ancestor; otherwise the
+        // parent's source geometry is no longer needed once it's sliced further down
+        detail::vt_features features;
+        detail::packed_features packed;
+        const bool compact = !parent.packed_source.empty();
+        // features left in a snapshot are read from it, and stay there until the split is done
+        const uint64_t mapped = parent.mapped_source;
+        if (!options.maxCacheBytes) {
+            features = std::move(parent.source_features);
+            packed = std::move(parent.packed_source);
+        }
+        auto& source = options.maxCacheBytes && !compact && !mapped ? parent.source_features : features;
+
+        lock.unlock();
+        try {
+            // packed and mapped features are only read from, so they're read without the lock
+            if (compact)
+                features = (options.maxCacheBytes ? parent.packed_source : packed).unpack(sqTolerances);
+            else if (mapped)
+                features = snapshot->readFeatures(mapped);
+            splitTile(source, false, parent.z, parent.x, parent.y, target);
+        } catch (...) {
+            lock.lock();
+            if (!options.maxCacheBytes) {
+                parent.packed_source = std::move(packed);
+                if (!compact)
+                    parent.source_features = std::move(features);
+            }
+            finishSplit(parent);
+            throw;
+        }
+        lock.lock();
+        finishSplit(parent);
+
+        if (options.maxCacheBytes)
+            cacheDrilled(parent, target);
+    }
+
+    detail::tile_store::iterator
     findParent(const uint8_t z, const uint32_t x, const uint32_t y) {
-        uint8_t z0 = z;
-        uint32_t x0 = x;
-        uint32_t y0 = y;
+        // only zoom levels that have any tiles are looked up
+        for (uint8_t z0 = z; z0-- > 0;) {
+            if (!tiles.hasZoom(z0))
+                continue;
+            const auto parent = tiles.find(toID(z0, x >> (z - z0), y >> (z - z0)));
+            if (parent != tiles.end())
+                return parent;
+        }
+        return tiles.end();
+    }
+
+    double tileTolerance(const uint8_t z) const {
+        const double z2 = 1u << z;
+        return z == options.maxZoom ? 0 : options.tolerance / (z2 * options.extent);
+    }
+
+    std::vector<double> squaredTolerances() const {
+        std::vector<double> result;
+        for (uint8_t z = 0; z <= options.maxZoom; ++z) {
+            const double tolerance = tileTolerance(z);
+            result.push_back(tolerance * tolerance);
+        }
+        return result;
+    }
+
+    // keep the features a tile can be drilled down from, moving them if they're owned
+    void keepSource(detail::InternalTile& tile, detail::vt_features& features, const bool owned) const {
+        if (options.compactSource && detail::packed_features::precise(tile.z, options.maxZoom, options.extent)) {
+            tile.packed_source = detail::packed_features(features, sqTolerances, tile.z, tile.x, tile.y);
+            tile.transform();
+        } else if (owned)
+            tile.source_features = std::move(features);
+        else
+            tile.source_features = features;
+    }
+
+    detail::InternalTile&
+    addTile(const detail::vt_features& features, const uint8_t z, const uint32_t x, const uint32_t y) {
+        detail::InternalTile tile{ features, z, x, y, options.extent, tileTolerance(z), options.lineMetrics,
+                                   options.sharedProperties };
+
+        std::lock_guard<std::shared_timed_mutex> lock(mutex);
+        auto& result = tiles.emplace(toID(z, x, y), std::move(tile)).first->second;
+        stats[z] = (stats.count(z) ? stats[z] + 1 : 1);
+        total++;
+        // printf("tile z%i-%i-%i\n", z, x, y);
+        return result;
+    }
+
+    // the features that a clip between k1 and k2 doesn't trivially reject
+    template <uint8_t I>
+    static detail::vt_features
+    overlapping(const detail::vt_features& features, const double k1, const double k2) {
+        detail::vt_features result;
+        for (const auto& feature : features) {
+            if (detail::get<I>(feature.bbox.max) >= k1 && detail::get<I>(feature.bbox.min) < k2)
+                result.push_back(feature);
+        }
+        return result;
+    }
+
+    // generate a tile that the changed features overlap again, along with the existing tiles below
+    // it that they overlap too; the other ones don't depend on them and are kept as they are
+    void updateTile(detail::vt_features& features,
+                    const detail::vt_features& changed,
+                    const uint8_t z,
+                    const uint32_t x,
+                    const uint32_t y) {
+        const auto it = tiles.find(toID(z, x, y));
+        if (it == tiles.end())
+            return;
 
-        const auto end = tiles.end();
-        auto parent = end;
+        const bool hadSource = it->second.hasSource();
+        bool leaf = true;
+        for (uint32_t i = 0; i < 4; ++i) {
+            if (tiles.count(toID(z + 1, x * 2 + (i & 1), y * 2 + (i >> 1))))
+                leaf = false;
+        }
+
+        removeTile({ z, x, y });
 
-        while ((parent == end) && (z0 != 0)) {
-            z0--;
-            x0 = x0 / 2;
-            y0 = y0 / 2;
-            parent = tiles.find(toID(z0, x0, y0));
+        // a leaf is split again like the first pass or a drill-down would
+        if (leaf) {
+            if (z <= options.indexMaxZoom) {
+                splitTile(features, true, z, x, y);
+            } else {
+                splitTile(features, true, z, x, y, { z, x, y, x, y });
+                if (options.maxCacheBytes)
+                    cacheTile({ z, x, y });
+            }
+            return;
         }
 
-        return parent;
+        auto& tile = addTile(features, z, x, y);
+        // with a cache budget, tiles drilled from keep their source
+        if (options.maxCacheBytes && hadSource)
+            keepSource(tile, features, false);
+        if (tile.source_features.empty())
+            tile.transform();
+        if (options.maxCacheBytes)
+            cacheTile({ z, x, y });
+
+        const double z2 = 1u << z;
+        const double p = 0.5 * options.buffer / options.extent;
+        const auto& min = tile.bbox.min;
+        const auto& max = tile.bbox.max;
+
+        for (uint32_t i = 0; i < 2; ++i) {
+            const double x1 = (x + 0.5 * i - p) / z2;
+            const double x2 = (x + 0.5 * (i + 1) + p) / z2;
+            const auto changedX = overlapping<0>(changed, x1, x2);
+            if (changedX.empty())
+                continue;
+            auto column = detail::clip<0>(features, x1, x2, min.x, max.x, options.lineMetrics);
+
+            for (uint32_t j = 0; j < 2; ++j) {
+                const double y1 = (y + 0.5 * j - p) / z2;
+                const double y2 = (y + 0.5 * (j + 1) + p) / z2;
+                const auto changedY = overlapping<1>(changedX, y1, y2);
+                if (changedY.empty())
+                    continue;
+                auto quadrant = detail::clip<1>(column, y1, y2, min.y, max.y, options.lineMetrics);
+                updateTile(quadrant, changedY, z + 1, x * 2 + i, y * 2 + j);
+            }
+        }
     }
 
-    void splitTile(const detail::vt_features& features,
+    // features are only moved from if they're owned by the split, and not read anymore afterwards
+    void splitTile(detail::vt_features& features,
+                   const bool owned,
                    const uint8_t z,
                    const uint32_t x,
                    const uint32_t y,
-                   const uint8_t cz = 0,
-                   const uint32_t cx = 0,
-                   const uint32_t cy = 0) {
+                   const TileRange& target = TileRange()) {
 
         const double z2 = 1u << z;
         const uint64_t id = toID(z, x, y);
 
-        auto it = tiles.find(id);
-
-        if (it == tiles.end()) {
-            const double tolerance =
-                (z == options.maxZoom ? 0 : options.tolerance / (z2 * options.extent));
-
-            it = tiles
-                     .emplace(id,
-                              detail::InternalTile{ features, z, x, y, options.extent, tolerance, options.lineMetrics })
-                     .first;
-            stats[z] = (stats.count(z) ? stats[z] + 1 : 1);
-            total++;
-            // printf("tile z%i-%i-%i\n", z, x, y);
+        // only the thread splitting this subtree creates or modifies its tiles, so the lock is
+        // just needed to keep the map itself consistent
+        detail::InternalTile* found = nullptr;
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(mutex);
+            const auto it = tiles.find(id);
+            if (it != tiles.end())
+                found = &it->second;
         }
+        const bool existed = found != nullptr;
 
-        auto& tile = it->second;
+        auto& tile = existed ? *found : addTile(features, z, x, y);
 
         if (features.empty())
             return;
 
         // if it's the first-pass tiling
-        if (cz == 0u) {
+        if (target.z == 0u) {
             // stop tiling if we reached max zoom, or if the tile is too simple
-            if (z == options.indexMaxZoom || tile.tile.num_points <= options.indexMaxPoints) {
-                tile.source_features = features;
+            if (z == options.indexMaxZoom || tile.numPoints() <= options.indexMaxPoints) {
+                keepSource(tile, features, owned);
                 return;
             }
 
-        } else { // drilldown to a specific tile;
+        } else { // drilldown to specific tiles;
             // stop tiling if we reached base zoom
-            if (z == options.maxZoom)
+            if (z == options.maxZoom) {
+                tile.transform();
+                return;
+            }
+
+            // a tile that existed already below the one drilled from (the only one whose features
+            // the split doesn't own) is left as it is: it's a sibling drilled into before (only
+            // possible with a cache budget), or the closest ancestor of target tiles that are
+            // drilled down to from there instead, which another thread may be doing
+            if (existed && owned)
                 return;
 
             // stop tiling if it's our target tile zoom
-            if (z == cz) {
-                tile.source_features = features;
+            if (z == target.z) {
+                keepSource(tile, features, owned);
                 return;
             }
 
-            // stop tiling if it's not an ancestor of the target tile
-            const double m = 1u << (cz - z);
-            if (x != static_cast<uint32_t>(std::floor(cx / m)) ||
-                y != static_cast<uint32_t>(std::floor(cy / m))) {
-                tile.source_features = features;
+            // stop tiling if it's not an ancestor of a target tile
+            const uint8_t d = target.z - z;
+            if (x < (target.minX >> d) || x > (target.maxX >> d) || y < (target.minY >> d) ||
+                y > (target.maxY >> d)) {
+                keepSource(tile, features, owned);
                 return;
             }
+
+            if (options.maxCacheBytes && !existed)
+                keepSource(tile, features, false);
         }
 
+        // the tile's features share their geometry with the source features it keeps; without
+        // them, it's transformed before the geometry is sliced and let go
+        if (tile.source_features.empty())
+            tile.transform();
+
         const double p = 0.5 * options.buffer / options.extent;
-        const auto& min = tile.bbox.min;
-        const auto& max = tile.bbox.max;
+        auto quadrants = detail::clipQuadrants(features, (x - p) / z2, (x + 0.5 + p) / z2, (x + 0.5 - p) / z2,
+                                               (x + 1 + p) / z2, (y - p) / z2, (y + 0.5 + p) / z2,
+                                               (y + 0.5 - p) / z2, (y + 1 + p) / z2, tile.bbox, options.lineMetrics);
+        // the features are all in the quadrants now, so they can go if they're the split's
+        if (owned)
+            detail::vt_features().swap(features);
 
-        const auto left = detail::clip<0>(features, (x - p) / z2, (x + 0.5 + p) / z2, min.x, max.x, options.lineMetrics);
+        // the four quadrants are independent, so the initial build splits them in parallel
+        const auto split = [&](const auto& a, const auto& b) {
+            if (target.z == 0u) {
+                forkJoin(a, b);
+            } else {
+                a();
+                b();
+            }
+        };
 
-        splitTile(detail::clip<1>(left, (y - p) / z2, (y + 0.5 + p) / z2, min.y, max.y, options.lineMetrics), z + 1,
-                  x * 2, y * 2, cz, cx, cy);
-        splitTile(detail::clip<1>(left, (y + 0.5 - p) / z2, (y + 1 + p) / z2, min.y, max.y, options.lineMetrics), z + 1,
-                  x * 2, y * 2 + 1, cz, cx, cy);
+        const auto splitQuadrant = [&](const uint32_t i, const uint32_t j) {
+            auto& quadrant = quadrants[i + 2 * j];
+            splitTile(quadrant, true, z + 1, x * 2 + i, y * 2 + j, target);
+            detail::vt_features().swap(quadrant);
+        };
 
-        const auto right =
-            detail::clip<0>(features, (x + 0.5 - p) / z2, (x + 1 + p) / z2, min.x, max.x, options.lineMetrics);
+        const auto splitColumn = [&](const uint32_t i) {
+            split([&] { splitQuadrant(i, 0); }, [&] { splitQuadrant(i, 1); });
+        };
 
-        splitTile(detail::clip<1>(right, (y - p) / z2, (y + 0.5 + p) / z2, min.y, max.y, options.lineMetrics), z + 1,
-                  x * 2 + 1, y * 2, cz, cx, cy);
-        splitTile(detail::clip<1>(right, (y + 0.5 - p) / z2, (y + 1 + p) / z2, min.y, max.y, options.lineMetrics), z + 1,
-                  x * 2 + 1, y * 2 + 1, cz, cx, cy);
+        split([&] { splitColumn(0); }, [&] { splitColumn(1); });
 
         // if we sliced further down, no need to keep source geometry
-        tile.source_features = {};
+        if (target.z == 0u || !options.maxCacheBytes) {
+            tile.transform();
+            tile.source_features = {};
+            tile.packed_source = {};
+            tile.mapped_source = 0;
+        }
     }
 };
 
@@ -2,10 +2,22 @@
 
 #include <mapbox/geojsonvt/types.hpp>
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
 namespace mapbox {
 namespace geojsonvt {
 namespace detail {
 
+template <uint8_t I>
+class dual_clipper;
+
 template <uint8_t I>
 class clipper {
 public:
@@ -25,22 +37,16 @@ public:
     }
 
     vt_geometry operator()(const vt_multi_point& points) const {
-        vt_multi_point part;
         for (const auto& p : points) {
-            const double ak = get<I>(p);
-            if (ak >= k1 && ak <= k2)
-                part.emplace_back(p);
+            keepPoint(p, get<I>(p));
         }
-        return part;
+        return takePoints();
     }
 
     vt_geometry operator()(const vt_line_string& line) const {
         vt_multi_line_string parts;
         clipLine(line, parts);
-        if (parts.size() == 1)
-            return parts[0];
-        else
-            return parts;
+        return lineParts(std::move(parts));
     }
 
     vt_geometry operator()(const vt_multi_line_string& lines) const {
@@ -48,10 +54,7 @@ public:
         for (const auto& line : lines) {
             clipLine(line, parts);
         }
-        if (parts.size() == 1)
-            return parts[0];
-        else
-            return parts;
+        return lineParts(std::move(parts));
     }
 
     vt_geometry operator()(const vt_polygon& polygon) const {
@@ -89,6 +92,38 @@ public:
     }
 
 private:
+    friend class dual_clipper<I>;
+
+    // the points of the slice or ring being clipped; they're collected here, in a buffer that's
+    // reused for every geometry the clipper is given, and copied out once it's complete, so
+    // that each slice is allocated once and at its final size
+    mutable std::vector<vt_point> kept;
+
+    // a line being clipped: the slice being collected, and the length of the line up to the
+    // segment being clipped
+    struct line_state {
+        vt_line_string slice;
+        double lineLen;
+    };
+
+    void keepPoint(const vt_point& p, const double ak) const {
+        if (ak >= k1 && ak <= k2)
+            kept.emplace_back(p);
+    }
+
+    vt_multi_point takePoints() const {
+        vt_multi_point part(kept.begin(), kept.end());
+        kept.clear();
+        return part;
+    }
+
+    static vt_geometry lineParts(vt_multi_line_string&& parts) {
+        if (parts.size() == 1)
+            return std::move(parts[0]);
+        else
+            return parts;
+    }
+
     vt_line_string newSlice(const vt_line_string& line) const {
         vt_line_string slice;
         slice.dist = line.dist;
@@ -99,158 +134,427 @@ private:
         return slice;
     }
 
-    void clipLine(const vt_line_string& line, vt_multi_line_string& slices) const {
-        const size_t len = line.size();
-        double lineLen = line.segStart;
-        double segLen = 0.0;
-        double t = 0.0;
+    void addSlice(vt_line_string& slice, vt_multi_line_string& slices) const {
+        slice.assign(kept.begin(), kept.end());
+        kept.clear();
+        slices.emplace_back(std::move(slice));
+    }
 
-        if (len < 2)
-            return;
+    line_state startLine(const vt_line_string& line) const {
+        return { newSlice(line), line.segStart };
+    }
 
-        vt_line_string slice = newSlice(line);
+    // where points are along the axis: below k1, between the lines (or NaN, which the segment
+    // clipping treats as between them), or above k2
+    enum : uint8_t { below, between, above };
 
-        for (size_t i = 0; i < (len - 1); ++i) {
-            const auto& a = line[i];
-            const auto& b = line[i + 1];
-            const double ak = get<I>(a);
-            const double bk = get<I>(b);
-            const bool isLastSeg = (i == (len - 2));
+    // lines and rings are clipped in blocks of points, classified up front
+    static constexpr size_t blockSize = 256;
 
-            if (lineMetrics) segLen = ::hypot((b.x - a.x), (b.y - a.y));
+    // classifies n points; there are no branches, so it doesn't mispredict on any mix of classes,
+    // and the compiler vectorizes it for targets that can gather the coordinates, such as AVX2
+    void classify(const vt_point* points, const size_t n, uint8_t* classes) const {
+        for (size_t i = 0; i < n; ++i) {
+            const double k = get<I>(points[i]);
+            classes[i] = uint8_t(between - (k < k1) + (k > k2));
+        }
+    }
 
-            if (ak < k1) {
-                if (bk > k2) { // ---|-----|-->
-                    t = calc_progress<I>(a, b, k1);
-                    slice.emplace_back(intersect<I>(a, b, k1, t));
-                    if (lineMetrics) slice.segStart = lineLen + segLen * t;
+    // the last of the points from i to n that are all in the same class as i, compared eight at a
+    // time while they are
+    static size_t runEnd(const uint8_t* classes, size_t i, const size_t n) {
+        const uint64_t run = classes[i] * 0x0101010101010101ull;
+        for (; i + 8 <= n; i += 8) {
+            uint64_t next;
+            std::memcpy(&next, classes + i + 1, sizeof(next));
+            if (next != run)
+                break;
+        }
+        while (i < n && classes[i + 1] == classes[i]) {
+            ++i;
+        }
+        return i;
+    }
 
-                    t = calc_progress<I>(a, b, k2);
-                    slice.emplace_back(intersect<I>(a, b, k2, t));
-                    if (lineMetrics) slice.segEnd = lineLen + segLen * t;
-                    slices.emplace_back(std::move(slice));
+    // clips the segment from a to b, whose coordinates along the axis are ak and bk
+    void clipSegment(const vt_line_string& line,
+                     line_state& state,
+                     const vt_point& a,
+                     const vt_point& b,
+                     const double ak,
+                     const double bk,
+                     const double segLen,
+                     const bool isLastSeg,
+                     vt_multi_line_string& slices) const {
+        auto& slice = state.slice;
+        const double lineLen = state.lineLen;
+        double t = 0.0;
 
-                    slice = newSlice(line);
+        if (ak < k1) {
+            if (bk > k2) { // ---|-----|-->
+                t = calc_progress<I>(a, b, k1);
+                kept.emplace_back(intersect<I>(a, b, k1, t));
+                if (lineMetrics) slice.segStart = lineLen + segLen * t;
 
-                } else if (bk > k1) { // ---|-->  |
-                    t = calc_progress<I>(a, b, k1);
-                    slice.emplace_back(intersect<I>(a, b, k1, t));
-                    if (lineMetrics) slice.segStart = lineLen + segLen * t;
-                    if (isLastSeg) slice.emplace_back(b); // last point
+                t = calc_progress<I>(a, b, k2);
+                kept.emplace_back(intersect<I>(a, b, k2, t));
+                if (lineMetrics) slice.segEnd = lineLen + segLen * t;
+                addSlice(slice, slices);
 
-                } else if (bk == k1 && !isLastSeg) { // --->|..  |
-                    if (lineMetrics) slice.segStart = lineLen + segLen;
-                    slice.emplace_back(b);
-                }
-            } else if (ak > k2) {
-                if (bk < k1) { // <--|-----|---
-                    t = calc_progress<I>(a, b, k2);
-                    slice.emplace_back(intersect<I>(a, b, k2, t));
-                    if (lineMetrics) slice.segStart = lineLen + segLen * t;
+                slice = newSlice(line);
 
-                    t = calc_progress<I>(a, b, k1);
-                    slice.emplace_back(intersect<I>(a, b, k1, t));
-                    if (lineMetrics) slice.segEnd = lineLen + segLen * t;
+            } else if (bk > k1) { // ---|-->  |
+                t = calc_progress<I>(a, b, k1);
+                kept.emplace_back(intersect<I>(a, b, k1, t));
+                if (lineMetrics) slice.segStart = lineLen + segLen * t;
+                if (isLastSeg) kept.emplace_back(b); // last point
 
-                    slices.emplace_back(std::move(slice));
+            } else if (bk == k1 && !isLastSeg) { // --->|..  |
+                if (lineMetrics) slice.segStart = lineLen + segLen;
+                kept.emplace_back(b);
+            }
+        } else if (ak > k2) {
+            if (bk < k1) { // <--|-----|---
+                t = calc_progress<I>(a, b, k2);
+                kept.emplace_back(intersect<I>(a, b, k2, t));
+                if (lineMetrics) slice.segStart = lineLen + segLen * t;
 
-                    slice = newSlice(line);
+                t = calc_progress<I>(a, b, k1);
+                kept.emplace_back(intersect<I>(a, b, k1, t));
+                if (lineMetrics) slice.segEnd = lineLen + segLen * t;
 
-                } else if (bk < k2) { // |  <--|---
-                    t = calc_progress<I>(a, b, k2);
-                    slice.emplace_back(intersect<I>(a, b, k2, t));
-                    if (lineMetrics) slice.segStart = lineLen + segLen * t;
-                    if (isLastSeg) slice.emplace_back(b); // last point
+                addSlice(slice, slices);
 
-                } else if (bk == k2 && !isLastSeg) { // |  ..|<---
-                    if (lineMetrics) slice.segStart = lineLen + segLen;
-                    slice.emplace_back(b);
-                }
-            } else {
-                slice.emplace_back(a);
-
-                if (bk < k1) { // <--|---  |
-                    t = calc_progress<I>(a, b, k1);
-                    slice.emplace_back(intersect<I>(a, b, k1, t));
-                    if (lineMetrics) slice.segEnd = lineLen + segLen * t;
-                    slices.emplace_back(std::move(slice));
-                    slice = newSlice(line);
-
-                } else if (bk > k2) { // |  ---|-->
-                    t = calc_progress<I>(a, b, k2);
-                    slice.emplace_back(intersect<I>(a, b, k2, t));
-                    if (lineMetrics) slice.segEnd = lineLen + segLen * t;
-                    slices.emplace_back(std::move(slice));
-                    slice = newSlice(line);
-
-                } else if (isLastSeg) { // | --> |
-                    slice.emplace_back(b);
+                slice = newSlice(line);
+
+            } else if (bk < k2) { // |  <--|---
+                t = calc_progress<I>(a, b, k2);
+                kept.emplace_back(intersect<I>(a, b, k2, t));
+                if (lineMetrics) slice.segStart = lineLen + segLen * t;
+                if (isLastSeg) kept.emplace_back(b); // last point
+
+            } else if (bk == k2 && !isLastSeg) { // |  ..|<---
+                if (lineMetrics) slice.segStart = lineLen + segLen;
+                kept.emplace_back(b);
+            }
+        } else {
+            kept.emplace_back(a);
+
+            if (bk < k1) { // <--|---  |
+                t = calc_progress<I>(a, b, k1);
+                kept.emplace_back(intersect<I>(a, b, k1, t));
+                if (lineMetrics) slice.segEnd = lineLen + segLen * t;
+                addSlice(slice, slices);
+                slice = newSlice(line);
+
+            } else if (bk > k2) { // |  ---|-->
+                t = calc_progress<I>(a, b, k2);
+                kept.emplace_back(intersect<I>(a, b, k2, t));
+                if (lineMetrics) slice.segEnd = lineLen + segLen * t;
+                addSlice(slice, slices);
+                slice = newSlice(line);
+
+            } else if (isLastSeg) { // | --> |
+                kept.emplace_back(b);
+            }
+        }
+    }
+
+    void finishLine(line_state& state, vt_multi_line_string& slices) const {
+        if (!kept.empty()) { // add the final slice
+            if (lineMetrics) state.slice.segEnd = state.lineLen;
+            addSlice(state.slice, slices);
+        }
+    }
+
+    double segmentLength(const vt_line_string& line, const size_t i) const {
+        const auto& a = line[i];
+        const auto& b = line[i + 1];
+        return lineMetrics ? ::hypot((b.x - a.x), (b.y - a.y)) : 0.0;
+    }
+
+    // Clips the segments of a line from the point first to the point last. The segments in a run
+    // of points on the same side of the lines are skipped, and the ones between them are copied,
+    // so that only the segments from one class to another are clipped one at a time.
+    void clipLineRange(const vt_line_string& line,
+                       line_state& state,
+                       const size_t first,
+                       const size_t last,
+                       vt_multi_line_string& slices) const {
+        uint8_t classes[blockSize + 1];
+        classify(&line[first], last - first + 1, classes);
+
+        for (size_t i = first; i < last;) {
+            const size_t j = first + runEnd(classes, i - first, last - first);
+            if (classes[i - first] == between) {
+                kept.insert(kept.end(), line.begin() + i, line.begin() + j);
+                if (j == line.size() - 1)
+                    kept.emplace_back(line[j]); // last point
+            }
+            if (lineMetrics) {
+                for (size_t k = i; k < j; ++k) {
+                    state.lineLen += segmentLength(line, k);
                 }
             }
+            if (j == last)
+                break;
+
+            const double segLen = segmentLength(line, j);
+            const auto& a = line[j];
+            const auto& b = line[j + 1];
+            clipSegment(line, state, a, b, get<I>(a), get<I>(b), segLen, j == line.size() - 2, slices);
+            if (lineMetrics) state.lineLen += segLen;
+            i = j + 1;
+        }
+    }
 
-            if (lineMetrics) lineLen += segLen;
+    void clipLine(const vt_line_string& line, vt_multi_line_string& slices) const {
+        const size_t len = line.size();
+        if (len < 2)
+            return;
+
+        auto state = startLine(line);
+        for (size_t i = 0; i < len - 1; i += blockSize) {
+            clipLineRange(line, state, i, std::min(i + blockSize, len - 1), slices);
         }
+        finishLine(state, slices);
+    }
 
-        if (!slice.empty()) { // add the final slice
-            if (lineMetrics) slice.segEnd = lineLen;
-            slices.emplace_back(std::move(slice));
+    // clips the segment from a to b of a ring, whose coordinates along the axis are ak and bk
+    void clipRingSegment(const vt_point& a,
+                         const vt_point& b,
+                         const double ak,
+                         const double bk,
+                         const bool isLastSeg) const {
+        if (ak < k1) {
+            if (bk > k1) {
+                // ---|-->  |
+                kept.emplace_back(intersect<I>(a, b, k1, calc_progress<I>(a, b, k1)));
+                if (bk > k2)
+                    // ---|-----|-->
+                    kept.emplace_back(intersect<I>(a, b, k2, calc_progress<I>(a, b, k2)));
+                else if (isLastSeg)
+                    kept.emplace_back(b); // last point
+            }
+        } else if (ak > k2) {
+            if (bk < k2) { // |  <--|---
+                kept.emplace_back(intersect<I>(a, b, k2, calc_progress<I>(a, b, k2)));
+                if (bk < k1) // <--|-----|---
+                    kept.emplace_back(intersect<I>(a, b, k1, calc_progress<I>(a, b, k1)));
+                else if (isLastSeg)
+                    kept.emplace_back(b); // last point
+            }
+        } else {
+            // | --> |
+            kept.emplace_back(a);
+            if (bk < k1)
+                // <--|---  |
+                kept.emplace_back(intersect<I>(a, b, k1, calc_progress<I>(a, b, k1)));
+            else if (bk > k2)
+                // |  ---|-->
+                kept.emplace_back(intersect<I>(a, b, k2, calc_progress<I>(a, b, k2)));
         }
     }
 
-    vt_linear_ring clipRing(const vt_linear_ring& ring) const {
-        const size_t len = ring.size();
+    vt_linear_ring finishRing(const vt_linear_ring& ring) const {
         vt_linear_ring slice;
         slice.area = ring.area;
 
-        if (len < 2)
-            return slice;
-
-        for (size_t i = 0; i < (len - 1); ++i) {
-            const auto& a = ring[i];
-            const auto& b = ring[i + 1];
-            const double ak = get<I>(a);
-            const double bk = get<I>(b);
-
-            if (ak < k1) {
-                if (bk > k1) {
-                    // ---|-->  |
-                    slice.emplace_back(intersect<I>(a, b, k1, calc_progress<I>(a, b, k1)));
-                    if (bk > k2)
-                        // ---|-----|-->
-                        slice.emplace_back(intersect<I>(a, b, k2, calc_progress<I>(a, b, k2)));
-                    else if (i == len - 2)
-                        slice.emplace_back(b); // last point
-                }
-            } else if (ak > k2) {
-                if (bk < k2) { // |  <--|---
-                    slice.emplace_back(intersect<I>(a, b, k2, calc_progress<I>(a, b, k2)));
-                    if (bk < k1) // <--|-----|---
-                        slice.emplace_back(intersect<I>(a, b, k1, calc_progress<I>(a, b, k1)));
-                    else if (i == len - 2)
-                        slice.emplace_back(b); // last point
-                }
-            } else {
-                // | --> |
-                slice.emplace_back(a);
-                if (bk < k1)
-                    // <--|---  |
-                    slice.emplace_back(intersect<I>(a, b, k1, calc_progress<I>(a, b, k1)));
-                else if (bk > k2)
-                    // |  ---|-->
-                    slice.emplace_back(intersect<I>(a, b, k2, calc_progress<I>(a, b, k2)));
+        // close the polygon if its endpoints are not the same after clipping
+        if (!kept.empty()) {
+            const auto first = kept.front();
+            if (first != kept.back()) {
+                kept.emplace_back(first);
             }
         }
 
-        // close the polygon if its endpoints are not the same after clipping
-        if (!slice.empty()) {
-            const auto& first = slice.front();
-            const auto& last = slice.back();
-            if (first != last) {
-                slice.emplace_back(first);
+        slice.assign(kept.begin(), kept.end());
+        kept.clear();
+        return slice;
+    }
+
+    // clips the segments of a ring from the point first to the point last, in runs as lines are
+    void clipRingRange(const vt_linear_ring& ring, const size_t first, const size_t last) const {
+        uint8_t classes[blockSize + 1];
+        classify(&ring[first], last - first + 1, classes);
+
+        for (size_t i = first; i < last;) {
+            const size_t j = first + runEnd(classes, i - first, last - first);
+            if (classes[i - first] == between)
+                kept.insert(kept.end(), ring.begin() + i, ring.begin() + j);
+            if (j == last)
+                break;
+
+            const auto& a = ring[j];
+            const auto& b = ring[j + 1];
+            clipRingSegment(a, b, get<I>(a), get<I>(b), j == ring.size() - 2);
+            i = j + 1;
+        }
+    }
+
+    vt_linear_ring clipRing(const vt_linear_ring& ring) const {
+        const size_t len = ring.size();
+        for (size_t i = 0; i + 1 < len; i += blockSize) {
+            clipRingRange(ring, i, std::min(i + blockSize, len - 1));
+        }
+        return finishRing(ring);
+    }
+};
+
+// Clips geometries between two pairs of axis-parallel lines at once, such as the two halves of a
+// tile, into the same parts as a clipper for each pair would. Each geometry is traversed once,
+// and each block of its points is clipped against both pairs of lines while it's in cache.
+template <uint8_t I>
+class dual_clipper {
+public:
+    dual_clipper(double k1, double k2, double k3, double k4, bool lineMetrics = false)
+        : first(k1, k2, lineMetrics), second(k3, k4, lineMetrics) {}
+
+    const clipper<I> first;
+    const clipper<I> second;
+
+    using parts = std::pair<vt_geometry, vt_geometry>;
+
+    parts operator()(const vt_empty& empty) const {
+        return { empty, empty };
+    }
+
+    parts operator()(const vt_point& point) const {
+        return { point, point };
+    }
+
+    parts operator()(const vt_multi_point& points) const {
+        for (const auto& p : points) {
+            const double ak = get<I>(p);
+            first.keepPoint(p, ak);
+            second.keepPoint(p, ak);
+        }
+        return { first.takePoints(), second.takePoints() };
+    }
+
+    parts operator()(const vt_line_string& line) const {
+        vt_multi_line_string firstParts;
+        vt_multi_line_string secondParts;
+        clipLine(line, firstParts, secondParts);
+        return { clipper<I>::lineParts(std::move(firstParts)), clipper<I>::lineParts(std::move(secondParts)) };
+    }
+
+    parts operator()(const vt_multi_line_string& lines) const {
+        vt_multi_line_string firstParts;
+        vt_multi_line_string secondParts;
+        for (const auto& line : lines) {
+            clipLine(line, firstParts, secondParts);
+        }
+        return { clipper<I>::lineParts(std::move(firstParts)), clipper<I>::lineParts(std::move(secondParts)) };
+    }
+
+    parts operator()(const vt_polygon& polygon) const {
+        std::pair<vt_polygon, vt_polygon> result;
+        clipPolygon(polygon, result.first, result.second);
+        return { std::move(result.first), std::move(result.second) };
+    }
+
+    parts operator()(const vt_multi_polygon& polygons) const {
+        std::pair<vt_multi_polygon, vt_multi_polygon> result;
+        for (const auto& polygon : polygons) {
+            vt_polygon p1;
+            vt_polygon p2;
+            clipPolygon(polygon, p1, p2);
+            if (!p1.empty())
+                result.first.emplace_back(std::move(p1));
+            if (!p2.empty())
+                result.second.emplace_back(std::move(p2));
+        }
+        return { std::move(result.first), std::move(result.second) };
+    }
+
+    parts operator()(const vt_geometry_collection& geometries) const {
+        std::pair<vt_geometry_collection, vt_geometry_collection> result;
+        for (const auto& geometry : geometries) {
+            auto clipped = vt_geometry::visit(geometry, [&](const auto& g) { return this->operator()(g); });
+            result.first.emplace_back(std::move(clipped.first));
+            result.second.emplace_back(std::move(clipped.second));
+        }
+        return { std::move(result.first), std::move(result.second) };
+    }
+
+private:
+    void clipLine(const vt_line_string& line, vt_multi_line_string& firstSlices, vt_multi_line_string& secondSlices) const {
+        const size_t len = line.size();
+        if (len < 2)
+            return;
+
+        auto firstState = first.startLine(line);
+        auto secondState = second.startLine(line);
+        for (size_t i = 0; i < len - 1; i += clipper<I>::blockSize) {
+            const size_t last = std::min(i + clipper<I>::blockSize, len - 1);
+            first.clipLineRange(line, firstState, i, last, firstSlices);
+            second.clipLineRange(line, secondState, i, last, secondSlices);
+        }
+        first.finishLine(firstState, firstSlices);
+        second.finishLine(secondState, secondSlices);
+    }
+
+    void clipPolygon(const vt_polygon& polygon, vt_polygon& firstRings, vt_polygon& secondRings) const {
+        for (const auto& ring : polygon) {
+            const size_t len = ring.size();
+            for (size_t i = 0; i + 1 < len; i += clipper<I>::blockSize) {
+                const size_t last = std::min(i + clipper<I>::blockSize, len - 1);
+                first.clipRingRange(ring, i, last);
+                second.clipRingRange(ring, i, last);
             }
+            auto firstRing = first.finishRing(ring);
+            if (!firstRing.empty())
+                firstRings.emplace_back(std::move(firstRing));
+            auto secondRing = second.finishRing(ring);
+            if (!secondRing.empty())
+                secondRings.emplace_back(std::move(secondRing));
         }
+    }
+};
 
-        return slice;
+// adds a feature with a clipped geometry, split into a feature per line with line metrics
+inline void addClipped(vt_features& clipped, vt_geometry&& geom, const vt_feature& feature, const bool lineMetrics) {
+    if (lineMetrics && geom.is<vt_multi_line_string>()) {
+        for (auto& segment : geom.get<vt_multi_line_string>()) {
+            clipped.emplace_back(std::move(segment), feature.properties, feature.id);
+        }
+    } else {
+        clipped.emplace_back(std::move(geom), feature.properties, feature.id);
+    }
+}
+
+// Where features are between two axis-parallel lines k1 and k2: all of them are inside or
+// outside if their extent along the axis (from minAll to maxAll) is, and otherwise each one is
+// by its bounding box, or crosses the lines and has to be clipped.
+template <uint8_t I>
+struct slab {
+    enum placement { outside, inside, across };
+
+    const double k1;
+    const double k2;
+    const bool allInside;
+    const bool allOutside;
+
+    slab(const double k1_, const double k2_, const double minAll, const double maxAll)
+        : k1(k1_),
+          k2(k2_),
+          allInside(minAll >= k1 && maxAll < k2),
+          allOutside(!allInside && (maxAll < k1 || minAll >= k2)) {}
+
+    placement place(const vt_feature& feature) const {
+        if (allInside)
+            return inside;
+        if (allOutside)
+            return outside;
+
+        const double min = get<I>(feature.bbox.min);
+        const double max = get<I>(feature.bbox.max);
+        if (min >= k1 && max < k2)
+            return inside;
+        if (max < k1 || min >= k2)
+            return outside;
+        return across;
     }
 };
 
@@ -261,59 +565,132 @@ private:
  *     |        |
  */
 
-template <uint8_t I>
-inline vt_features clip(const vt_features& features,
+// when given an rvalue, features that don't need clipping are moved instead of copied
+template <uint8_t I, class Features>
+inline vt_features clip(Features&& features,
                         const double k1,
                         const double k2,
                         const double minAll,
                         const double maxAll,
                         const bool lineMetrics) {
+    using feature_ref = std::conditional_t<std::is_lvalue_reference<Features>::value,
+                                           const vt_feature&, vt_feature&&>;
 
-    if (minAll >= k1 && maxAll < k2) // trivial accept
-        return features;
+    const slab<I> bounds{ k1, k2, minAll, maxAll };
+    if (bounds.allInside) // trivial accept
+        return std::forward<Features>(features);
 
-    if (maxAll < k1 || minAll >= k2) // trivial reject
+    if (bounds.allOutside) // trivial reject
         return {};
 
     vt_features clipped;
     clipped.reserve(features.size());
+    const clipper<I> clipGeometry{ k1, k2, lineMetrics };
 
-    for (const auto& feature : features) {
-        const auto& geom = feature.geometry;
+    for (auto& feature : features) {
         assert(feature.properties);
-        const auto& props = feature.properties;
-        const auto& id = feature.id;
+        switch (bounds.place(feature)) {
+        case slab<I>::inside: // trivial accept
+            clipped.emplace_back(static_cast<feature_ref>(feature));
+            break;
+        case slab<I>::outside: // trivial reject
+            break;
+        case slab<I>::across:
+            addClipped(clipped, vt_geometry::visit(*feature.geometry, clipGeometry), feature, lineMetrics);
+            break;
+        }
+    }
 
-        const double min = get<I>(feature.bbox.min);
-        const double max = get<I>(feature.bbox.max);
+    return clipped;
+}
+
+// Splits features into the quadrants of a tile whose features are within bbox: between x1 and
+// x2 or x3 and x4 (its left and right halves, with their buffers), and between y1 and y2 or y3
+// and y4, in the order top left, top right, bottom left, bottom right. The quadrants are the same
+// as clipping the features to each half and then each half to its quadrants gives, but each
+// feature is traversed once along each axis, and its parts go to the quadrants straight away.
+inline std::array<vt_features, 4> clipQuadrants(const vt_features& features,
+                                                const double x1,
+                                                const double x2,
+                                                const double x3,
+                                                const double x4,
+                                                const double y1,
+                                                const double y2,
+                                                const double y3,
+                                                const double y4,
+                                                const mapbox::geometry::box<double>& bbox,
+                                                const bool lineMetrics) {
+    const std::array<slab<0>, 2> columns = { { { x1, x2, bbox.min.x, bbox.max.x },
+                                               { x3, x4, bbox.min.x, bbox.max.x } } };
+    const std::array<slab<1>, 2> rows = { { { y1, y2, bbox.min.y, bbox.max.y },
+                                            { y3, y4, bbox.min.y, bbox.max.y } } };
+    const dual_clipper<0> clipX{ x1, x2, x3, x4, lineMetrics };
+    const dual_clipper<1> clipY{ y1, y2, y3, y4, lineMetrics };
+
+    // room for the features whose bounding boxes overlap each quadrant, which is one for each of
+    // their parts unless they're split into several lines
+    std::array<std::size_t, 4> sizes = { { 0, 0, 0, 0 } };
+    for (const auto& feature : features) {
+        for (std::size_t i = 0; i < 4; ++i) {
+            if (columns[i & 1].place(feature) != slab<0>::outside && rows[i >> 1].place(feature) != slab<1>::outside)
+                ++sizes[i];
+        }
+    }
+    std::array<vt_features, 4> quadrants;
+    for (std::size_t i = 0; i < 4; ++i) {
+        quadrants[i].reserve(sizes[i]);
+    }
 
-        if (min >= k1 && max < k2) { // trivial accept
-            clipped.emplace_back(feature);
+    // puts a feature, or a part of one, in the half i of a column
+    const auto split = [&](const vt_feature& feature, const std::size_t i) {
+        const auto top = rows[0].place(feature);
+        const auto bottom = rows[1].place(feature);
+        if (top == slab<1>::across && bottom == slab<1>::across) {
+            auto parts = vt_geometry::visit(*feature.geometry, clipY);
+            addClipped(quadrants[i], std::move(parts.first), feature, lineMetrics);
+            addClipped(quadrants[i + 2], std::move(parts.second), feature, lineMetrics);
+            return;
+        }
+        if (top == slab<1>::inside)
+            quadrants[i].push_back(feature);
+        else if (top == slab<1>::across)
+            addClipped(quadrants[i], vt_geometry::visit(*feature.geometry, clipY.first), feature, lineMetrics);
+        if (bottom == slab<1>::inside)
+            quadrants[i + 2].push_back(feature);
+        else if (bottom == slab<1>::across)
+            addClipped(quadrants[i + 2], vt_geometry::visit(*feature.geometry, clipY.second), feature, lineMetrics);
+    };
+
+    // the parts of the feature being split in each column, if it's clipped
+    std::array<vt_features, 2> parts;
 
-        } else if (max < k1 || min >= k2) { // trivial reject
-            continue;
+    for (const auto& feature : features) {
+        assert(feature.properties);
+        const std::array<slab<0>::placement, 2> placements = { { columns[0].place(feature),
+                                                                 columns[1].place(feature) } };
+        if (placements[0] == slab<0>::across && placements[1] == slab<0>::across) {
+            auto clipped = vt_geometry::visit(*feature.geometry, clipX);
+            addClipped(parts[0], std::move(clipped.first), feature, lineMetrics);
+            addClipped(parts[1], std::move(clipped.second), feature, lineMetrics);
+        } else if (placements[0] == slab<0>::across) {
+            addClipped(parts[0], vt_geometry::visit(*feature.geometry, clipX.first), feature, lineMetrics);
+        } else if (placements[1] == slab<0>::across) {
+            addClipped(parts[1], vt_geometry::visit(*feature.geometry, clipX.second), feature, lineMetrics);
+        }
 
-        } else {
-            const auto& clippedGeom = vt_geometry::visit(geom, clipper<I>{ k1, k2, lineMetrics });
-
-            clippedGeom.match(
-                [&](const auto&) {
-                    clipped.emplace_back(clippedGeom, props, id);
-                },
-                [&](const vt_multi_line_string& result) {
-                    if (lineMetrics) {
-                        for (const auto& segment : result) {
-                            clipped.emplace_back(segment, props, id);
-                        }
-                    } else {
-                        clipped.emplace_back(clippedGeom, props, id);
-                    }
+        for (std::size_t i = 0; i < 2; ++i) {
+            if (placements[i] == slab<0>::inside) {
+                split(feature, i);
+            } else {
+                for (const auto& part : parts[i]) {
+                    split(part, i);
                 }
-            );
+                parts[i].clear();
+            }
         }
     }
 
-    return clipped;
+    return quadrants;
 }
 
 } // namespace detail
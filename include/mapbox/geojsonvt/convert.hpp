@@ -1,12 +1,20 @@
 #pragma once
 
+#include <mapbox/geojsonvt/mercator.hpp>
 #include <mapbox/geojsonvt/simplify.hpp>
 #include <mapbox/geojsonvt/types.hpp>
 #include <mapbox/geometry.hpp>
 #include <mapbox/feature.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <string>
+#include <unordered_set>
+#include <vector>
 
 namespace mapbox {
 namespace geojsonvt {
@@ -20,26 +28,63 @@ struct project {
         return empty;
     }
 
+    // Projects the points (or longitudes and latitudes) from first to last to out, which may be
+    // first itself. The latitudes are projected a block at a time with the batch kernel, and the
+    // ones it doesn't handle one at a time.
+    template <class InputIt, class OutputIt>
+    static OutputIt points(InputIt first, const InputIt last, OutputIt out) {
+        constexpr std::size_t block = 64;
+        double lat[block];
+        double y[block];
+        while (first != last) {
+            std::size_t n = 0;
+            for (auto it = first; it != last && n < block; ++it) {
+                lat[n++] = it->y;
+            }
+            mercator_y(lat, y, n);
+            for (std::size_t i = 0; i < n; ++i, ++first) {
+                const double x = first->x / 360 + 0.5;
+                *out++ = vt_point(x, std::abs(lat[i]) <= mercator_max_latitude ? y[i] : mercator_y(lat[i]), 0.0);
+            }
+        }
+        return out;
+    }
+
     vt_point operator()(const geometry::point<double>& p) {
-        const double sine = std::sin(p.y * M_PI / 180);
-        const double x = p.x / 360 + 0.5;
-        const double y =
-            std::max(std::min(0.5 - 0.25 * std::log((1 + sine) / (1 - sine)) / M_PI, 1.0), 0.0);
-        return { x, y, 0.0 };
+        vt_point result{ 0, 0 };
+        points(&p, &p + 1, &result);
+        return result;
+    }
+
+    vt_multi_point operator()(const geometry::multi_point<double>& multiPoint) {
+        vt_multi_point result;
+        result.reserve(multiPoint.size());
+        points(multiPoint.begin(), multiPoint.end(), std::back_inserter(result));
+        return result;
     }
 
-    vt_line_string operator()(const geometry::line_string<double>& points) {
+    vt_line_string operator()(const geometry::line_string<double>& line) {
         vt_line_string result;
-        const size_t len = points.size();
+        result.reserve(line.size());
+        points(line.begin(), line.end(), std::back_inserter(result));
+        measure(result);
+        return result;
+    }
 
-        if (len == 0)
-            return result;
+    vt_linear_ring operator()(const geometry::linear_ring<double>& ring) {
+        vt_linear_ring result;
+        result.reserve(ring.size());
+        points(ring.begin(), ring.end(), std::back_inserter(result));
+        measure(result);
+        return result;
+    }
 
-        result.reserve(len);
+    // computes the length of a line whose points are projected already, and simplifies it
+    void measure(vt_line_string& result) const {
+        const size_t len = result.size();
 
-        for (const auto& p : points) {
-            result.push_back(operator()(p));
-        }
+        if (len == 0)
+            return;
 
         for (size_t i = 0; i < len - 1; ++i) {
             const auto& a = result[i];
@@ -51,22 +96,14 @@ struct project {
 
         result.segStart = 0;
         result.segEnd = result.dist;
-
-        return result;
     }
 
-    vt_linear_ring operator()(const geometry::linear_ring<double>& ring) {
-        vt_linear_ring result;
-        const size_t len = ring.size();
+    // computes the area of a ring whose points are projected already, and simplifies it
+    void measure(vt_linear_ring& result) const {
+        const size_t len = result.size();
 
         if (len == 0)
-            return result;
-
-        result.reserve(len);
-
-        for (const auto& p : ring) {
-            result.push_back(operator()(p));
-        }
+            return;
 
         double area = 0.0;
 
@@ -78,8 +115,6 @@ struct project {
         result.area = std::abs(area / 2);
 
         simplify(result, tolerance);
-
-        return result;
     }
 
     vt_geometry operator()(const geometry::geometry<double>& geometry) {
@@ -98,19 +133,102 @@ struct project {
     }
 };
 
+// which properties convert keeps: the ones with the given keys (all of them if there are none)
+// that the predicate accepts, and with numericOnly, only numbers and booleans
+struct property_filter {
+    const std::unordered_set<std::string>& keys;
+    const std::function<bool(const std::string&, const value&)>& predicate;
+    const bool numericOnly;
+
+    bool keepsAll() const {
+        return keys.empty() && !predicate && !numericOnly;
+    }
+
+    bool operator()(const std::string& key, const value& v) const {
+        if (!keys.empty() && !keys.count(key))
+            return false;
+        if (numericOnly && !v.is<double>() && !v.is<uint64_t>() && !v.is<int64_t>() && !v.is<bool>())
+            return false;
+        return !predicate || predicate(key, v);
+    }
+};
+
+// projects a single feature, as features are added to an index one at a time
+inline vt_feature convert(const feature::feature<double>& feature,
+                          const double tolerance,
+                          const identifier& id,
+                          const property_filter* filter = nullptr) {
+    auto geometry = geometry::geometry<double>::visit(feature.geometry, project{ tolerance });
+    if (!filter || filter->keepsAll())
+        return { std::move(geometry), feature.properties, id };
+
+    // only the kept properties are copied, so that the tiles don't carry the others
+    auto properties = std::make_shared<property_map>();
+    for (const auto& property : feature.properties) {
+        if ((*filter)(property.first, property.second))
+            properties->emplace(property);
+    }
+    return { std::move(geometry), std::move(properties), id };
+}
+
+// projects a collection of features on up to `threads` threads, in blocks that the threads take
+// in turn; the result is the same on any number of threads, in the same order and with the same
+// generated ids
 inline vt_features convert(const feature::feature_collection<double>& features,
-                           const double tolerance, bool generateId) {
+                           const double tolerance, bool generateId, uint64_t genId = 0,
+                           const property_filter* filter = nullptr, uint32_t threads = 1) {
+    const auto convertRange = [&](const std::size_t first, const std::size_t last, vt_features& projected) {
+        projected.reserve(projected.size() + (last - first));
+        for (std::size_t i = first; i < last; ++i) {
+            const auto& feature = features[i];
+            const identifier featureId = generateId ? identifier(uint64_t(genId + i)) : feature.id;
+            projected.push_back(convert(feature, tolerance, featureId, filter));
+        }
+    };
+
+    // the features are handed out in blocks, so that there are no threads for just a few of them
+    constexpr std::size_t blockSize = 64;
+    const std::size_t blocks = (features.size() + blockSize - 1) / blockSize;
+    const std::size_t workers = std::min<std::size_t>(std::max(threads, 1u), blocks);
+
     vt_features projected;
-    projected.reserve(features.size());
-    uint64_t genId = 0;
-    for (const auto& feature : features) {
-        identifier featureId = feature.id;
-        if (generateId) {
-            featureId = { uint64_t {genId++} };
+    if (workers <= 1) {
+        convertRange(0, features.size(), projected);
+        return projected;
+    }
+
+    std::vector<vt_features> converted(blocks);
+    std::atomic<std::size_t> next{ 0 };
+    std::atomic<bool> failed{ false };
+    const auto work = [&] {
+        while (!failed) {
+            const std::size_t block = next++;
+            if (block >= blocks)
+                break;
+            try {
+                convertRange(block * blockSize, std::min((block + 1) * blockSize, features.size()),
+                             converted[block]);
+            } catch (...) {
+                // the other threads stop at their next block
+                failed = true;
+                throw;
+            }
         }
-        projected.emplace_back(
-            geometry::geometry<double>::visit(feature.geometry, project{ tolerance }),
-            feature.properties, featureId);
+    };
+
+    // an error is rethrown here once the other threads have stopped, as their futures wait for them
+    std::vector<std::future<void>> helpers;
+    for (std::size_t i = 1; i < workers; ++i) {
+        helpers.push_back(std::async(std::launch::async, work));
+    }
+    work();
+    for (auto& helper : helpers) {
+        helper.get();
+    }
+
+    projected.reserve(features.size());
+    for (auto& block : converted) {
+        std::move(block.begin(), block.end(), std::back_inserter(projected));
     }
     return projected;
 }
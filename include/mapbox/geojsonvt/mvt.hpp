@@ -0,0 +1,303 @@
+#pragma once
+
+#include <mapbox/geojsonvt/tile.hpp>
+#include <mapbox/geojsonvt/types.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace mapbox {
+namespace geojsonvt {
+namespace detail {
+
+// Encodes tiles as Mapbox Vector Tiles (version 2.1) with a single layer, straight from the flat
+// features of an InternalTile, whether its output Tile has been built or not. Keys and values are
+// deduplicated as features are written, and the tags of a property map that several features
+// share are only looked up once. Rings are rewound to the winding order the specification
+// requires, and points that rounding made repeat are skipped. The writer keeps its buffers
+// between tiles.
+class mvt_writer {
+public:
+    std::string encode(const InternalTile& tile, const std::string& name) {
+        layer.clear();
+        keys.clear();
+        keyList.clear();
+        values.clear();
+        valueList.clear();
+        tagCache.clear();
+        written = 0;
+
+        bytes(layer, 1, name);
+        const auto& flat = tile.getFlatTile();
+        for (std::size_t i = 0; i < flat.size(); ++i) {
+            tags.clear();
+            addTags(flat, flat.property_indices[i]);
+            if (!flat.clip_start.empty() && !std::isnan(flat.clip_start[i])) {
+                addTag("mapbox_clip_start", flat.clip_start[i]);
+                addTag("mapbox_clip_end", flat.clip_end[i]);
+            }
+            addFeature(flat, i);
+        }
+        if (!written)
+            return {};
+
+        for (const auto* key : keyList) {
+            bytes(layer, 3, *key);
+        }
+        for (const auto* value : valueList) {
+            bytes(layer, 4, *value);
+        }
+        field(layer, 5, 0);
+        varint(layer, tile.extent);
+        field(layer, 15, 0);
+        varint(layer, 2);
+
+        std::string result;
+        bytes(result, 3, layer);
+        return result;
+    }
+
+private:
+    enum : uint32_t { move_to = 1, line_to = 2, close_path = 7 };
+
+    std::string layer;
+    std::string feature;
+    std::string scratch;
+    std::size_t written = 0;
+
+    // indices of the keys and encoded values written so far, and the keys and values in order
+    std::unordered_map<std::string, uint32_t> keys;
+    std::vector<const std::string*> keyList;
+    std::unordered_map<std::string, uint32_t> values;
+    std::vector<const std::string*> valueList;
+
+    // the tags of the property maps of the tile, by index
+    std::unordered_map<uint32_t, std::vector<uint32_t>> tagCache;
+    std::vector<uint32_t> tags;
+    std::vector<uint32_t> commands;
+    std::vector<mapbox::geometry::point<int16_t>> ring;
+    int32_t cursorX = 0;
+    int32_t cursorY = 0;
+
+    static void varint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    static void field(std::string& out, const uint32_t number, const uint32_t type) {
+        varint(out, (number << 3) | type);
+    }
+
+    static void bytes(std::string& out, const uint32_t number, const std::string& data) {
+        field(out, number, 2);
+        varint(out, data.size());
+        out.append(data);
+    }
+
+    static void packed(std::string& out, const uint32_t number, const std::vector<uint32_t>& data) {
+        std::size_t size = 0;
+        for (const auto value : data) {
+            size += 1 + (value >= 1u << 7) + (value >= 1u << 14) + (value >= 1u << 21) + (value >= 1u << 28);
+        }
+        field(out, number, 2);
+        varint(out, size);
+        for (const auto value : data) {
+            varint(out, value);
+        }
+    }
+
+    static uint32_t zigzag(const int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    // the Value message for a property value; false for values vector tiles can't hold
+    struct value_encoder {
+        std::string& out;
+
+        bool operator()(const null_value&) const {
+            return false;
+        }
+        bool operator()(const bool value) const {
+            field(out, 7, 0);
+            varint(out, value);
+            return true;
+        }
+        bool operator()(const uint64_t value) const {
+            field(out, 5, 0);
+            varint(out, value);
+            return true;
+        }
+        bool operator()(const int64_t value) const {
+            field(out, 6, 0);
+            varint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+            return true;
+        }
+        bool operator()(const double value) const {
+            field(out, 3, 1);
+            char data[sizeof(double)];
+            std::memcpy(data, &value, sizeof(double));
+            out.append(data, sizeof(double));
+            return true;
+        }
+        bool operator()(const std::string& value) const {
+            bytes(out, 1, value);
+            return true;
+        }
+        template <class T>
+        bool operator()(const T&) const {
+            return false;
+        }
+    };
+
+    void addTag(const std::string& key, const value& property) {
+        scratch.clear();
+        if (!value::visit(property, value_encoder{ scratch }))
+            return;
+
+        auto k = keys.emplace(key, uint32_t(keys.size()));
+        if (k.second)
+            keyList.push_back(&k.first->first);
+        auto v = values.emplace(scratch, uint32_t(values.size()));
+        if (v.second)
+            valueList.push_back(&v.first->first);
+
+        tags.push_back(k.first->second);
+        tags.push_back(v.first->second);
+    }
+
+    void addTags(const FlatTile& flat, const uint32_t index) {
+        const auto cached = tagCache.find(index);
+        if (cached != tagCache.end()) {
+            tags.insert(tags.end(), cached->second.begin(), cached->second.end());
+            return;
+        }
+        for (const auto& property : *flat.properties[index]) {
+            addTag(property.first, property.second);
+        }
+        tagCache.emplace(index, tags);
+    }
+
+    void addFeature(const FlatTile& flat, const std::size_t i) {
+        commands.clear();
+        cursorX = 0;
+        cursorY = 0;
+
+        const uint32_t firstPart = flat.feature_offsets[i];
+        const uint32_t lastPart = flat.feature_offsets[i + 1];
+        switch (flat.types[i]) {
+        case FlatTile::Point: {
+            const uint32_t first = flat.ring_offsets[flat.part_offsets[firstPart]];
+            const uint32_t last = flat.ring_offsets[flat.part_offsets[lastPart]];
+            if (first == last)
+                return;
+            command(move_to, last - first);
+            for (uint32_t p = first; p < last; ++p) {
+                moveCursor(flat.points[p]);
+            }
+            break;
+        }
+        case FlatTile::LineString:
+            for (uint32_t part = firstPart; part < lastPart; ++part) {
+                distinct(flat, flat.part_offsets[part]);
+                if (ring.size() >= 2)
+                    writeLine();
+            }
+            break;
+        case FlatTile::Polygon:
+            for (uint32_t part = firstPart; part < lastPart; ++part) {
+                for (uint32_t r = flat.part_offsets[part]; r < flat.part_offsets[part + 1]; ++r) {
+                    // holes of a degenerate exterior ring go with it
+                    if (!addRing(flat, r, r == flat.part_offsets[part]) && r == flat.part_offsets[part])
+                        break;
+                }
+            }
+            break;
+        default:
+            return;
+        }
+        if (commands.empty())
+            return;
+
+        const auto& id = flat.ids[i];
+        feature.clear();
+        if (id.is<uint64_t>()) {
+            field(feature, 1, 0);
+            varint(feature, id.get<uint64_t>());
+        } else if (id.is<int64_t>() && id.get<int64_t>() >= 0) {
+            field(feature, 1, 0);
+            varint(feature, static_cast<uint64_t>(id.get<int64_t>()));
+        }
+        if (!tags.empty())
+            packed(feature, 2, tags);
+        field(feature, 3, 0);
+        varint(feature, flat.types[i]);
+        packed(feature, 4, commands);
+
+        bytes(layer, 2, feature);
+        ++written;
+    }
+
+    void command(const uint32_t id, const uint32_t count) {
+        commands.push_back((id & 0x7) | (count << 3));
+    }
+
+    void moveCursor(const mapbox::geometry::point<int16_t>& p) {
+        commands.push_back(zigzag(p.x - cursorX));
+        commands.push_back(zigzag(p.y - cursorY));
+        cursorX = p.x;
+        cursorY = p.y;
+    }
+
+    // points of a line or ring without the ones that repeat the previous one
+    void distinct(const FlatTile& flat, const uint32_t r) {
+        ring.clear();
+        for (uint32_t i = flat.ring_offsets[r]; i < flat.ring_offsets[r + 1]; ++i) {
+            if (ring.empty() || flat.points[i] != ring.back())
+                ring.push_back(flat.points[i]);
+        }
+    }
+
+    void writeLine() {
+        command(move_to, 1);
+        moveCursor(ring[0]);
+        command(line_to, uint32_t(ring.size() - 1));
+        for (std::size_t i = 1; i < ring.size(); ++i) {
+            moveCursor(ring[i]);
+        }
+    }
+
+    // exterior rings have a positive area in tile coordinates, where y points down, and interior
+    // rings a negative one; degenerate rings are skipped
+    bool addRing(const FlatTile& flat, const uint32_t r, const bool exterior) {
+        distinct(flat, r);
+        if (ring.size() > 1 && ring.front() == ring.back())
+            ring.pop_back();
+        if (ring.size() < 3)
+            return false;
+
+        int64_t area = 0;
+        for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+            area += int64_t(ring[j].x) * ring[i].y - int64_t(ring[i].x) * ring[j].y;
+        }
+        if (area == 0)
+            return false;
+        if ((area > 0) != exterior)
+            std::reverse(ring.begin(), ring.end());
+
+        writeLine();
+        command(close_path, 1);
+        return true;
+    }
+};
+
+} // namespace detail
+} // namespace geojsonvt
+} // namespace mapbox
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <mapbox/geojsonvt/types.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace mapbox {
+namespace geojsonvt {
+namespace detail {
+
+// Source features packed into flat arrays, for tiles that keep them to drill down from
+// (Options::compactSource). Packing is lossy, and unpacked features are what the tiles below are
+// generated from. Coordinates are stored relative to the tile, as 32-bit fixed-point
+// numbers with 30 fractional bits: wrapped and clipped features stay well within [-2, 2) tiles,
+// and the precision is 2^-30 of the tile, which precise() checks against the pixels of the zoom
+// levels the features are drilled down to. The importance of a point is only ever
+// compared with the squared tolerances of the zoom levels, so just the first level it's shown at
+// is stored, and it's unpacked as a value between the tolerances of that level and the one above.
+// Lengths, areas, bounding boxes and properties are kept as they are.
+class packed_features {
+public:
+    packed_features() = default;
+
+    // sqTolerances has the squared tolerance of each zoom level up to the max zoom, which is
+    // needed again to unpack the features
+    packed_features(const vt_features& features,
+                    const std::vector<double>& sqTolerances_,
+                    const uint8_t z,
+                    const uint32_t x,
+                    const uint32_t y)
+        : z2(std::ldexp(1.0, z)), tx(x), ty(y), sqTolerances(&sqTolerances_) {
+        items.reserve(features.size());
+        for (const auto& feature : features) {
+            items.push_back({ feature.properties, feature.id, feature.bbox, feature.num_points });
+            vt_geometry::visit(*feature.geometry, [&](const auto& g) {
+                // `this->` is a workaround for https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61636
+                this->pack(g);
+            });
+        }
+        sqTolerances = nullptr;
+
+        // the arrays are kept for as long as the tile, so they don't keep room to grow
+        coords.shrink_to_fit();
+        levels.shrink_to_fit();
+        sizes.shrink_to_fit();
+        types.shrink_to_fit();
+        measures.shrink_to_fit();
+    }
+
+    vt_features unpack(const std::vector<double>& sq) const {
+        // the importance of a point from the first level it's shown at, or one past the last
+        std::vector<double> importances(sq.size() + 1);
+        for (std::size_t z = 0; z < sq.size(); ++z) {
+            importances[z] = sq[z] > 0 ? sq[z] * 2 : z > 0 ? sq[z - 1] / 2 : 1;
+        }
+
+        vt_features result;
+        result.reserve(items.size());
+        cursor at{ importances };
+        for (const auto& item : items) {
+            result.emplace_back(std::make_shared<const vt_geometry>(unpackGeometry(at)), item.properties,
+                                item.id, item.bbox, item.num_points);
+        }
+        return result;
+    }
+
+    bool empty() const {
+        return items.empty();
+    }
+
+    // whether the features of a tile at zoom z can be packed with at most a sixteenth of a pixel
+    // of error at maxZoom; features further above maxZoom are kept as they are
+    static bool precise(const uint8_t z, const uint8_t maxZoom, const uint16_t extent) {
+        return z >= maxZoom || std::ldexp(double(extent), maxZoom - z + 4) <= scale;
+    }
+
+    // the heap memory the features take up, not counting their properties
+    std::size_t memory() const {
+        return items.capacity() * sizeof(item) + coords.capacity() * sizeof(int32_t) +
+               levels.capacity() * sizeof(uint8_t) + sizes.capacity() * sizeof(uint32_t) +
+               types.capacity() * sizeof(uint8_t) + measures.capacity() * sizeof(double);
+    }
+
+private:
+    struct item {
+        std::shared_ptr<const property_map> properties;
+        identifier id;
+        mapbox::geometry::box<double> bbox;
+        uint32_t num_points;
+    };
+
+    // the geometry types, in the order they're visited in
+    enum : uint8_t { empty_, point, multi_point, line_string, multi_line_string, polygon, multi_polygon, collection };
+
+    struct cursor {
+        const std::vector<double>& importances;
+        std::size_t coord = 0;
+        std::size_t size = 0;
+        std::size_t type = 0;
+        std::size_t measure = 0;
+    };
+
+    static constexpr double scale = 1 << 30;
+
+    static int32_t fixed(const double v) {
+        const double scaled = std::round(v * scale);
+        return int32_t(std::max(std::min(scaled, double(std::numeric_limits<int32_t>::max())),
+                                double(std::numeric_limits<int32_t>::min())));
+    }
+
+    // the first zoom level that a point of the given importance is shown at
+    uint8_t level(const double z) const {
+        const auto& sq = *sqTolerances;
+        return uint8_t(std::find_if(sq.begin(), sq.end(), [&](const double t) { return z > t; }) - sq.begin());
+    }
+
+    void addPoint(const vt_point& p) {
+        coords.push_back(fixed(p.x * z2 - tx));
+        coords.push_back(fixed(p.y * z2 - ty));
+        levels.push_back(level(p.z));
+    }
+
+    template <class Points>
+    void addPoints(const Points& points) {
+        sizes.push_back(uint32_t(points.size()));
+        for (const auto& p : points) {
+            addPoint(p);
+        }
+    }
+
+    void pack(const vt_empty&) {
+        types.push_back(empty_);
+    }
+
+    void pack(const vt_point& p) {
+        types.push_back(point);
+        addPoint(p);
+    }
+
+    void pack(const vt_multi_point& points) {
+        types.push_back(multi_point);
+        addPoints(points);
+    }
+
+    void addLine(const vt_line_string& line) {
+        addPoints(line);
+        measures.push_back(line.dist);
+        measures.push_back(line.segStart);
+        measures.push_back(line.segEnd);
+    }
+
+    void pack(const vt_line_string& line) {
+        types.push_back(line_string);
+        addLine(line);
+    }
+
+    void pack(const vt_multi_line_string& lines) {
+        types.push_back(multi_line_string);
+        sizes.push_back(uint32_t(lines.size()));
+        for (const auto& line : lines) {
+            addLine(line);
+        }
+    }
+
+    void addPolygon(const vt_polygon& rings) {
+        sizes.push_back(uint32_t(rings.size()));
+        for (const auto& ring : rings) {
+            addPoints(ring);
+            measures.push_back(ring.area);
+        }
+    }
+
+    void pack(const vt_polygon& rings) {
+        types.push_back(polygon);
+        addPolygon(rings);
+    }
+
+    void pack(const vt_multi_polygon& polygons) {
+        types.push_back(multi_polygon);
+        sizes.push_back(uint32_t(polygons.size()));
+        for (const auto& rings : polygons) {
+            addPolygon(rings);
+        }
+    }
+
+    void pack(const vt_geometry_collection& geometries) {
+        types.push_back(collection);
+        sizes.push_back(uint32_t(geometries.size()));
+        for (const auto& geometry : geometries) {
+            vt_geometry::visit(geometry, [&](const auto& g) { this->pack(g); });
+        }
+    }
+
+    vt_point getPoint(cursor& at) const {
+        const double x = (coords[at.coord++] / scale + tx) / z2;
+        const double y = (coords[at.coord++] / scale + ty) / z2;
+        return { x, y, at.importances[levels[at.coord / 2 - 1]] };
+    }
+
+    template <class Points>
+    Points getPoints(cursor& at) const {
+        Points points;
+        points.resize(sizes[at.size++], { 0, 0 });
+        for (auto& p : points) {
+            p = getPoint(at);
+        }
+        return points;
+    }
+
+    vt_line_string getLine(cursor& at) const {
+        auto line = getPoints<vt_line_string>(at);
+        line.dist = measures[at.measure++];
+        line.segStart = measures[at.measure++];
+        line.segEnd = measures[at.measure++];
+        return line;
+    }
+
+    vt_polygon getPolygon(cursor& at) const {
+        vt_polygon rings(sizes[at.size++]);
+        for (auto& ring : rings) {
+            ring = getPoints<vt_linear_ring>(at);
+            ring.area = measures[at.measure++];
+        }
+        return rings;
+    }
+
+    vt_geometry unpackGeometry(cursor& at) const {
+        switch (types[at.type++]) {
+        case point:
+            return getPoint(at);
+        case multi_point:
+            return getPoints<vt_multi_point>(at);
+        case line_string:
+            return getLine(at);
+        case multi_line_string: {
+            vt_multi_line_string lines(sizes[at.size++]);
+            for (auto& line : lines) {
+                line = getLine(at);
+            }
+            return lines;
+        }
+        case polygon:
+            return getPolygon(at);
+        case multi_polygon: {
+            vt_multi_polygon polygons(sizes[at.size++]);
+            for (auto& rings : polygons) {
+                rings = getPolygon(at);
+            }
+            return polygons;
+        }
+        case collection: {
+            vt_geometry_collection geometries;
+            geometries.resize(sizes[at.size++]);
+            for (auto& geometry : geometries) {
+                geometry = unpackGeometry(at);
+            }
+            return geometries;
+        }
+        default:
+            return vt_empty();
+        }
+    }
+
+    std::vector<item> items;
+    std::vector<int32_t> coords;
+    std::vector<uint8_t> levels;
+    // the number of points, lines, rings, polygons or geometries in each of the nested parts
+    std::vector<uint32_t> sizes;
+    std::vector<uint8_t> types;
+    // the length and line metrics of each line, and the area of each ring
+    std::vector<double> measures;
+
+    // the number of tiles across the world at the tile's zoom, and the tile's coordinates
+    double z2 = 1;
+    double tx = 0;
+    double ty = 0;
+
+    // only set while packing
+    const std::vector<double>* sqTolerances = nullptr;
+};
+
+} // namespace detail
+} // namespace geojsonvt
+} // namespace mapbox
@@ -0,0 +1,723 @@
+#pragma once
+
+#include <mapbox/geojsonvt.hpp>
+#include <mapbox/geojsonvt/convert.hpp>
+#include <mapbox/geojsonvt/types.hpp>
+
+#include <rapidjson/error/en.h>
+#include <rapidjson/reader.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace mapbox {
+namespace geojsonvt {
+namespace detail {
+
+// RapidJSON SAX handler that reads GeoJSON straight into projected features, without building
+// mapbox::geometry objects first. Coordinates are only buffered until the geometry they belong
+// to ends, since its type may come after them; they're then projected all at once, and lines and
+// rings are measured and simplified the way convert does it. The features are the ones convert makes
+// of mapbox::geojson::parse(json), with the same errors for input it rejects, and each one is
+// handed on as soon as it's complete.
+class geojson_reader : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, geojson_reader> {
+public:
+    using sink_type = std::function<void(vt_feature&&)>;
+
+    geojson_reader(const double tolerance, const property_filter* filter_, sink_type sink_)
+        : projector{ tolerance },
+          filter(filter_ && !filter_->keepsAll() ? filter_ : nullptr),
+          sink(std::move(sink_)) {
+    }
+
+    // why the handler stopped the parser
+    std::string error;
+
+    bool Null() {
+        if (in(context::coordinates))
+            return fail("coordinates must be arrays of numbers");
+        switch (next()) {
+        case role::skip:
+            return true;
+        case role::geometry:
+            return geometry(vt_empty());
+        case role::properties:
+            return true;
+        case role::id:
+            return fail("Feature id must be a string or number");
+        case role::property:
+            return put(mapbox::feature::null_value);
+        default:
+            return unexpected();
+        }
+    }
+
+    bool Bool(const bool b) {
+        if (in(context::coordinates))
+            return fail("coordinates must be arrays of numbers");
+        switch (next()) {
+        case role::skip:
+            return true;
+        case role::id:
+            return fail("Feature id must be a string or number");
+        case role::property:
+            return put(b);
+        default:
+            return unexpected();
+        }
+    }
+
+    // non-negative integers are unsigned, like in a parsed document
+    bool Int(const int i) {
+        return Int64(i);
+    }
+    bool Int64(const int64_t i) {
+        return i < 0 ? number(double(i), i) : number(double(i), uint64_t(i));
+    }
+    bool Uint(const unsigned u) {
+        return number(double(u), uint64_t(u));
+    }
+    bool Uint64(const uint64_t u) {
+        return number(double(u), u);
+    }
+    bool Double(const double d) {
+        return number(d, d);
+    }
+
+    bool String(const char* str, const rapidjson::SizeType length, bool) {
+        if (in(context::coordinates))
+            return fail("coordinates must be arrays of numbers");
+        switch (next()) {
+        case role::skip:
+            return true;
+        case role::type:
+            return type(str, length);
+        case role::id:
+            owner().id = std::string(str, length);
+            return true;
+        case role::property:
+            return put(std::string(str, length));
+        default:
+            return unexpected();
+        }
+    }
+
+    bool StartObject() {
+        if (stack.empty()) {
+            stack.push_back(context::top);
+            top = {};
+            pushGeometry();
+            return true;
+        }
+        if (in(context::coordinates))
+            return fail("coordinates must be arrays of numbers");
+        switch (next()) {
+        case role::skip:
+            stack.push_back(context::skip);
+            return true;
+        case role::feature:
+            stack.push_back(context::feature);
+            feature = {};
+            return true;
+        case role::geometry:
+            stack.push_back(context::geometry);
+            pushGeometry();
+            return true;
+        case role::properties:
+            stack.push_back(context::properties);
+            return true;
+        case role::property:
+            stack.push_back(context::value);
+            values.emplace_back();
+            values.back().object = true;
+            return true;
+        default:
+            return unexpected();
+        }
+    }
+
+    bool Key(const char* str, const rapidjson::SizeType length, bool) {
+        switch (stack.back()) {
+        case context::top:
+            return key(top, str, length);
+        case context::feature:
+            return key(feature, str, length);
+        case context::geometry:
+            return key(frames[depth - 1], str, length);
+        case context::properties: {
+            auto& state = owner();
+            state.key.assign(str, length);
+            // the first of duplicate properties is the one kept
+            const bool skip = (filter && !filter->keys.empty() && !filter->keys.count(state.key)) ||
+                              state.properties.count(state.key);
+            nextRole = skip ? role::skip : role::property;
+            return true;
+        }
+        case context::value:
+            values.back().key.assign(str, length);
+            nextRole = role::property;
+            return true;
+        default:
+            return true;
+        }
+    }
+
+    bool EndObject(rapidjson::SizeType) {
+        const auto ended = stack.back();
+        stack.pop_back();
+        switch (ended) {
+        case context::top:
+            return finishTop();
+        case context::feature: {
+            if (!(feature.seen & bit(role::type)))
+                return fail("Feature must have a type property");
+            if (feature.type != "Feature")
+                return fail("Feature type must be Feature");
+            if (!(feature.seen & bit(role::geometry)))
+                return fail("Feature must have a geometry property");
+            auto result = make(feature);
+            if (kind == top_kind::collection) {
+                sink(std::move(result));
+            } else if (kind == top_kind::unknown) {
+                pending.push_back(std::move(result));
+            }
+            return true;
+        }
+        case context::geometry: {
+            vt_geometry result;
+            if (!finishGeometry(frames[--depth], result))
+                return false;
+            return geometry(std::move(result));
+        }
+        case context::value: {
+            auto map = std::move(values.back().map);
+            values.pop_back();
+            return put(std::move(map));
+        }
+        default:
+            return true;
+        }
+    }
+
+    bool StartArray() {
+        if (in(context::coordinates)) {
+            auto& f = frames[depth - 1];
+            if (f.kinds[f.level] == numbers)
+                return fail("coordinates must be arrays of numbers");
+            f.kinds[f.level] = arrays;
+            if (f.level == 3)
+                return fail("coordinates are nested too deeply");
+            f.kinds[++f.level] = none;
+            f.numbers = 0;
+            return true;
+        }
+        switch (next()) {
+        case role::skip:
+            stack.push_back(context::skip);
+            return true;
+        case role::features:
+            stack.push_back(context::features);
+            return true;
+        case role::geometries:
+            stack.push_back(context::geometries);
+            return true;
+        case role::coordinates: {
+            stack.push_back(context::coordinates);
+            auto& f = frames[depth - 1];
+            f.points.clear();
+            for (auto& ends : f.ends) {
+                ends.clear();
+            }
+            f.items = {};
+            f.kinds[0] = none;
+            f.level = 0;
+            f.numbers = 0;
+            f.positions = 0;
+            f.containers = 0;
+            return true;
+        }
+        case role::property:
+            stack.push_back(context::value);
+            values.emplace_back();
+            return true;
+        default:
+            return unexpected();
+        }
+    }
+
+    bool EndArray(rapidjson::SizeType) {
+        if (in(context::coordinates)) {
+            auto& f = frames[depth - 1];
+            const uint8_t l = f.level;
+            if (f.kinds[l] == numbers) {
+                if (f.numbers < 2)
+                    return fail("coordinates array must have at least 2 numbers");
+                f.points.emplace_back(f.x, f.y);
+                f.positions |= 1u << l;
+            } else {
+                f.containers |= 1u << l;
+                if (l < 3)
+                    f.ends[l].push_back(f.items[l + 1]);
+            }
+            ++f.items[l];
+            if (l == 0) {
+                stack.pop_back();
+            } else {
+                --f.level;
+            }
+            return true;
+        }
+        const auto ended = stack.back();
+        stack.pop_back();
+        if (ended == context::value) {
+            auto array = std::move(values.back().array);
+            values.pop_back();
+            return put(std::move(array));
+        }
+        return true;
+    }
+
+private:
+    // what the value being read is part of
+    enum class context : uint8_t {
+        top,
+        features,
+        feature,
+        geometry,
+        geometries,
+        coordinates,
+        properties,
+        value,
+        skip
+    };
+
+    // what the next value is for
+    enum class role : uint8_t {
+        root,
+        skip,
+        type,
+        features,
+        feature,
+        geometry,
+        geometries,
+        coordinates,
+        properties,
+        id,
+        property
+    };
+
+    // what the document turns out to be, once the type of its root object has been read
+    enum class top_kind : uint8_t { unknown, collection, feature, geometry };
+
+    // what an array in the coordinates holds
+    enum : uint8_t { none, numbers, arrays };
+
+    static uint16_t bit(const role r) {
+        return uint16_t(1u << uint8_t(r));
+    }
+
+    struct feature_state {
+        std::string type;
+        vt_geometry geometry;
+        identifier id;
+        property_map properties;
+        // the key of the property being read
+        std::string key;
+        // the members read already; the first of duplicate members is the one used
+        uint16_t seen = 0;
+    };
+
+    struct geometry_frame {
+        std::string type;
+        uint16_t seen = 0;
+        vt_geometry_collection geometries;
+
+        // The positions (projected once the geometry ends), and for the arrays at each of the levels above them, where
+        // each one ends among the items of the level below.
+        std::vector<vt_point> points;
+        std::array<std::vector<std::size_t>, 3> ends;
+        std::array<std::size_t, 4> items;
+        std::array<uint8_t, 4> kinds;
+        // the levels positions and other arrays were found at
+        uint8_t positions = 0;
+        uint8_t containers = 0;
+        uint8_t level = 0;
+        uint32_t numbers = 0;
+        double x = 0;
+        double y = 0;
+    };
+
+    struct value_frame {
+        bool object = false;
+        std::vector<value> array;
+        property_map map;
+        std::string key;
+    };
+
+    bool in(const context c) const {
+        return !stack.empty() && stack.back() == c;
+    }
+
+    role next() const {
+        if (stack.empty())
+            return role::root;
+        switch (stack.back()) {
+        case context::features:
+            return role::feature;
+        case context::geometries:
+            return role::geometry;
+        case context::value:
+            return values.back().object ? nextRole : role::property;
+        case context::skip:
+            return role::skip;
+        default:
+            return nextRole;
+        }
+    }
+
+    // the feature whose members are being read
+    feature_state& owner() {
+        return std::find(stack.begin(), stack.end(), context::feature) != stack.end() ? feature : top;
+    }
+
+    bool fail(std::string message) {
+        error = std::move(message);
+        return false;
+    }
+
+    bool unexpected() {
+        switch (next()) {
+        case role::root:
+            return fail("GeoJSON must be an object");
+        case role::type:
+            return fail("type must be a string");
+        case role::features:
+            return fail("FeatureCollection features property must be an array");
+        case role::feature:
+            return fail("Feature must be an object");
+        case role::geometry:
+            return fail("Geometry must be an object");
+        case role::geometries:
+            return fail("GeometryCollection geometries property must be an array");
+        case role::coordinates:
+            return fail("coordinates property must be an array");
+        case role::properties:
+            return fail("properties must be an object");
+        default:
+            return fail("Feature id must be a string or number");
+        }
+    }
+
+    template <class T>
+    bool number(const double d, const T v) {
+        if (in(context::coordinates)) {
+            auto& f = frames[depth - 1];
+            if (f.kinds[f.level] == arrays)
+                return fail("coordinates must be arrays of numbers");
+            f.kinds[f.level] = numbers;
+            if (f.numbers == 0) {
+                f.x = d;
+            } else if (f.numbers == 1) {
+                f.y = d;
+            }
+            ++f.numbers;
+            return true;
+        }
+        switch (next()) {
+        case role::skip:
+            return true;
+        case role::id:
+            owner().id = v;
+            return true;
+        case role::property:
+            return put(v);
+        default:
+            return unexpected();
+        }
+    }
+
+    static bool equals(const char* str, const rapidjson::SizeType length, const char* name) {
+        return length == std::strlen(name) && std::memcmp(str, name, length) == 0;
+    }
+
+    static role member(const char* str, const rapidjson::SizeType length) {
+        if (equals(str, length, "type"))
+            return role::type;
+        if (equals(str, length, "features"))
+            return role::features;
+        if (equals(str, length, "geometry"))
+            return role::geometry;
+        if (equals(str, length, "properties"))
+            return role::properties;
+        if (equals(str, length, "id"))
+            return role::id;
+        if (equals(str, length, "coordinates"))
+            return role::coordinates;
+        if (equals(str, length, "geometries"))
+            return role::geometries;
+        return role::skip;
+    }
+
+    // whether an object of the given kind uses a member
+    static bool uses(const top_kind k, const role r) {
+        switch (r) {
+        case role::type:
+            return true;
+        case role::features:
+            return k == top_kind::collection || k == top_kind::unknown;
+        case role::geometry:
+        case role::properties:
+        case role::id:
+            return k == top_kind::feature || k == top_kind::unknown;
+        case role::coordinates:
+        case role::geometries:
+            return k == top_kind::geometry || k == top_kind::unknown;
+        default:
+            return false;
+        }
+    }
+
+    template <class State>
+    bool key(State& state, const char* str, const rapidjson::SizeType length) {
+        const role r = member(str, length);
+        const top_kind k = in(context::top) ? kind
+                         : in(context::feature) ? top_kind::feature : top_kind::geometry;
+        if (r == role::skip || !uses(k, r) || (state.seen & bit(r))) {
+            nextRole = role::skip;
+        } else {
+            state.seen |= bit(r);
+            nextRole = r;
+        }
+        return true;
+    }
+
+    bool type(const char* str, const rapidjson::SizeType length) {
+        if (in(context::feature)) {
+            feature.type.assign(str, length);
+            return true;
+        }
+        auto& f = frames[depth - 1];
+        f.type.assign(str, length);
+        if (in(context::top)) {
+            if (f.type == "FeatureCollection") {
+                kind = top_kind::collection;
+                for (auto& pendingFeature : pending) {
+                    sink(std::move(pendingFeature));
+                }
+            } else {
+                kind = f.type == "Feature" ? top_kind::feature : top_kind::geometry;
+            }
+            pending.clear();
+        }
+        return true;
+    }
+
+    bool put(value v) {
+        if (!in(context::value)) {
+            auto& state = owner();
+            if (!filter || (*filter)(state.key, v))
+                state.properties.emplace(std::move(state.key), std::move(v));
+            return true;
+        }
+        auto& frame = values.back();
+        if (frame.object) {
+            frame.map.emplace(std::move(frame.key), std::move(v));
+        } else {
+            frame.array.push_back(std::move(v));
+        }
+        return true;
+    }
+
+    // hands a complete geometry to the feature or collection it's part of
+    bool geometry(vt_geometry result) {
+        if (in(context::geometries)) {
+            frames[depth - 1].geometries.push_back(std::move(result));
+        } else {
+            owner().geometry = std::move(result);
+        }
+        return true;
+    }
+
+    void pushGeometry() {
+        if (depth == frames.size())
+            frames.emplace_back();
+        auto& f = frames[depth++];
+        f.type.clear();
+        f.seen = 0;
+        f.geometries.clear();
+        f.points.clear();
+    }
+
+    bool finishTop() {
+        auto& f = frames[--depth];
+        if (!(top.seen & bit(role::type)))
+            return fail("GeoJSON must have a type property");
+        switch (kind) {
+        case top_kind::collection:
+            if (!(top.seen & bit(role::features)))
+                return fail("FeatureCollection must have features property");
+            return true;
+        case top_kind::feature:
+            if (!(top.seen & bit(role::geometry)))
+                return fail("Feature must have a geometry property");
+            sink(make(top));
+            return true;
+        default: {
+            f.seen = top.seen;
+            vt_geometry result;
+            if (!finishGeometry(f, result))
+                return false;
+            sink(vt_feature{ std::move(result), std::make_shared<property_map>(), identifier() });
+            return true;
+        }
+        }
+    }
+
+    vt_feature make(feature_state& state) {
+        return { std::move(state.geometry),
+                 std::make_shared<property_map>(std::move(state.properties)), state.id };
+    }
+
+    // how deep the positions of a geometry type are nested in its coordinates
+    static int positionLevel(const std::string& type) {
+        if (type == "Point")
+            return 0;
+        if (type == "MultiPoint" || type == "LineString")
+            return 1;
+        if (type == "Polygon" || type == "MultiLineString")
+            return 2;
+        if (type == "MultiPolygon")
+            return 3;
+        return -1;
+    }
+
+    bool finishGeometry(geometry_frame& f, vt_geometry& result) {
+        if (!(f.seen & bit(role::type)))
+            return fail("Geometry must have a type property");
+        if (f.type == "GeometryCollection") {
+            if (!(f.seen & bit(role::geometries)))
+                return fail("GeometryCollection must have a geometries property");
+            result = std::move(f.geometries);
+            return true;
+        }
+        if (!(f.seen & bit(role::coordinates)))
+            return fail(f.type + " geometry must have a coordinates property");
+        const int level = positionLevel(f.type);
+        if (level < 0)
+            return fail(f.type + " not yet implemented");
+        if ((f.positions & ~(1u << level)) || (f.containers >> level))
+            return fail("coordinates of a " + f.type + " must be nested " +
+                        std::to_string(level + 1) + " deep");
+
+        project::points(f.points.begin(), f.points.end(), f.points.begin());
+        const auto& points = f.points;
+        if (f.type == "Point") {
+            result = points.front();
+        } else if (f.type == "MultiPoint") {
+            result = vt_multi_point(points.begin(), points.end());
+        } else if (f.type == "LineString") {
+            result = part<vt_line_string>(f, 0, points.size());
+        } else if (f.type == "MultiLineString") {
+            result = parts<vt_line_string>(f, 1, 0, f.ends[1].size());
+        } else if (f.type == "Polygon") {
+            result = parts<vt_linear_ring>(f, 1, 0, f.ends[1].size());
+        } else {
+            vt_multi_polygon polygons;
+            polygons.reserve(f.ends[1].size());
+            std::size_t first = 0;
+            for (const auto last : f.ends[1]) {
+                polygons.push_back(parts<vt_linear_ring>(f, 2, first, last));
+                first = last;
+            }
+            result = std::move(polygons);
+        }
+        return true;
+    }
+
+    // the line or ring made of the given positions
+    template <class T>
+    T part(const geometry_frame& f, const std::size_t first, const std::size_t last) {
+        T result;
+        result.assign(f.points.begin() + first, f.points.begin() + last);
+        projector.measure(result);
+        return result;
+    }
+
+    // the lines or rings among the arrays of the given level
+    template <class T>
+    std::vector<T> parts(const geometry_frame& f, const uint8_t level, const std::size_t first, const std::size_t last) {
+        std::vector<T> result;
+        result.reserve(last - first);
+        std::size_t begin = first ? f.ends[level][first - 1] : 0;
+        for (std::size_t i = first; i < last; ++i) {
+            const std::size_t end = f.ends[level][i];
+            result.push_back(part<T>(f, begin, end));
+            begin = end;
+        }
+        return result;
+    }
+
+    project projector;
+    const property_filter* const filter;
+    const sink_type sink;
+
+    std::vector<context> stack;
+    role nextRole = role::skip;
+    top_kind kind = top_kind::unknown;
+    feature_state top;
+    feature_state feature;
+    // features read before the type of the root object, which can only be used once it's known
+    vt_features pending;
+    // the geometries being read, innermost last; kept between features for their buffers
+    std::vector<geometry_frame> frames;
+    std::size_t depth = 0;
+    std::vector<value_frame> values;
+};
+
+// parses GeoJSON text and hands each of its features to the sink, projected with the given
+// tolerance and filtered like convert does
+inline void parse(const std::string& json,
+                  const double tolerance,
+                  const property_filter* filter,
+                  geojson_reader::sink_type sink) {
+    geojson_reader handler{ tolerance, filter, std::move(sink) };
+    rapidjson::Reader reader;
+    rapidjson::StringStream stream(json.c_str());
+    const rapidjson::ParseResult result = reader.Parse(stream, handler);
+    if (result.IsError()) {
+        if (result.Code() == rapidjson::kParseErrorTermination && !handler.error.empty())
+            throw std::runtime_error(handler.error);
+        throw std::runtime_error("JSON error at " + std::to_string(result.Offset()) + " - " +
+                                 rapidjson::GetParseError_En(result.Code()));
+    }
+}
+
+inline vt_features parse(const std::string& json, const double tolerance, const property_filter* filter = nullptr) {
+    vt_features features;
+    parse(json, tolerance, filter, [&](vt_feature&& feature) { features.push_back(std::move(feature)); });
+    return features;
+}
+
+} // namespace detail
+
+// Builds a tile index from GeoJSON text. It's the index GeoJSONVT makes of
+// mapbox::geojson::parse(json), without building the geometry objects in between.
+inline std::unique_ptr<GeoJSONVT> parse(const std::string& json, const Options& options = Options()) {
+    const double tolerance = (options.tolerance / options.extent) / (1u << options.maxZoom);
+    const detail::property_filter filter{ options.propertyKeys, options.propertyFilter,
+                                          options.numericProperties };
+    GeoJSONVT::Builder builder{ options };
+    detail::parse(json, tolerance, &filter,
+                  [&](detail::vt_feature&& feature) { builder.add(std::move(feature)); });
+    return builder.build();
+}
+
+} // namespace geojsonvt
+} // namespace mapbox
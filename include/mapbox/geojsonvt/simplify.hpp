@@ -2,6 +2,14 @@
 
 #include <mapbox/geojsonvt/types.hpp>
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#include <utility>
+#include <vector>
+
 namespace mapbox {
 namespace geojsonvt {
 namespace detail {
@@ -33,39 +41,123 @@ inline double getSqSegDist(const vt_point& p, const vt_point& a, const vt_point&
     return dx * dx + dy * dy;
 }
 
-// calculate simplification data using optimized Douglas-Peucker algorithm
+inline uint64_t bitsOf(const double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    return bits;
+}
+
+inline double fromBits(const uint64_t bits) {
+    double v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+// The square distances of n points to the segment from a to b, exactly as getSqSegDist computes
+// them. The loop has no branches, so that the compiler can vectorize it: the comparisons of the
+// projection t are made on its bits, as the compiler doesn't vectorize a floating-point comparison
+// that picks which arithmetic is done, and the points are picked with bit masks.
+inline void getSqSegDists(const vt_point* points, const std::size_t n, const vt_point& a, const vt_point& b,
+                          double* sqDists) {
+    // copied, as the compiler can't tell that sqDists doesn't overlap them
+    const double ax = a.x;
+    const double ay = a.y;
+    const uint64_t bxBits = bitsOf(b.x);
+    const uint64_t byBits = bitsOf(b.y);
+    const double dx = b.x - ax;
+    const double dy = b.y - ay;
+    const double sqLength = dx * dx + dy * dy;
+
+    for (std::size_t i = 0; i < n; ++i) {
+        const double px = points[i].x;
+        const double py = points[i].y;
+        // NaN if a and b are the same point, which picks a, as getSqSegDist does
+        const double t = ((px - ax) * dx + (py - ay) * dy) / sqLength;
+
+        // the sign bit of each of these is set where the comparison holds: the bits of doubles
+        // that aren't negative or NaN compare like the doubles, and a comparison of the bits is
+        // the sign of their difference (SSE2 can't compare 64-bit integers)
+        const uint64_t u = bitsOf(t);
+        const uint64_t ordered = (u - 0x7ff0000000000001ull) & ~u;                  // 0 <= t <= inf
+        const uint64_t along = 0 - (((0 - u) & ordered) >> 63);                    // t > 0
+        const uint64_t past = 0 - (((0x3ff0000000000000ull - u) & ordered) >> 63); // t > 1
+
+        // a + d * 0 is a, so only t is picked before the arithmetic
+        const double s = fromBits(u & along);
+        const double x = fromBits((bxBits & past) | (bitsOf(ax + dx * s) & ~past));
+        const double y = fromBits((byBits & past) | (bitsOf(ay + dy * s) & ~past));
+
+        const double ex = px - x;
+        const double ey = py - y;
+        sqDists[i] = ex * ex + ey * ey;
+    }
+}
+
+// calculate simplification data using optimized Douglas-Peucker algorithm, splitting the ranges
+// left to split from a stack rather than recursively, as long lines would go very deep
 inline void simplify(std::vector<vt_point>& points, size_t first, size_t last, double sqTolerance) {
-    double maxSqDist = sqTolerance;
-    size_t index = 0;
-    const int64_t mid = first + ((last - first) >> 1);
-    int64_t minPosToMid = last - first;
-
-    for (auto i = first + 1; i < last; i++) {
-        const double sqDist = getSqSegDist(points[i], points[first], points[last]);
-
-        if (sqDist > maxSqDist) {
-            index = i;
-            maxSqDist = sqDist;
-
-        } else if (sqDist == maxSqDist) {
-            // a workaround to ensure we choose a pivot close to the middle of the list,
-            // reducing recursion depth, for certain degenerate inputs
-            // https://github.com/mapbox/geojson-vt/issues/104
-            auto posToMid = std::abs(static_cast<int64_t>(i) - mid);
-            if (posToMid < minPosToMid) {
-                index = i;
-                minPosToMid = posToMid;
+    // the distances are computed a block at a time, and then searched for the farthest point
+    constexpr std::size_t blockSize = 256;
+    double sqDists[blockSize];
+
+    std::vector<std::pair<size_t, size_t>> ranges{ { first, last } };
+    while (!ranges.empty()) {
+        std::tie(first, last) = ranges.back();
+        ranges.pop_back();
+
+        double maxSqDist = sqTolerance;
+        size_t index = 0;
+        const int64_t mid = first + ((last - first) >> 1);
+        int64_t minPosToMid = last - first;
+
+        for (auto start = first + 1; start < last; start += blockSize) {
+            const size_t n = std::min(blockSize, last - start);
+            getSqSegDists(&points[start], n, points[first], points[last], sqDists);
+
+            // most blocks have no point as far as the farthest one so far, and are skipped; the
+            // maximum is taken in four lanes, which don't wait on each other
+            double blockMax[4] = { 0, 0, 0, 0 };
+            size_t j = 0;
+            for (; j + 4 <= n; j += 4) {
+                for (size_t k = 0; k < 4; k++) {
+                    blockMax[k] = sqDists[j + k] > blockMax[k] ? sqDists[j + k] : blockMax[k];
+                }
+            }
+            for (; j < n; j++) {
+                blockMax[0] = sqDists[j] > blockMax[0] ? sqDists[j] : blockMax[0];
+            }
+            if (std::max(std::max(blockMax[0], blockMax[1]), std::max(blockMax[2], blockMax[3])) < maxSqDist)
+                continue;
+
+            for (size_t k = 0; k < n; k++) {
+                const auto i = start + k;
+                const double sqDist = sqDists[k];
+
+                if (sqDist > maxSqDist) {
+                    index = i;
+                    maxSqDist = sqDist;
+
+                } else if (sqDist == maxSqDist) {
+                    // a workaround to ensure we choose a pivot close to the middle of the list,
+                    // reducing recursion depth, for certain degenerate inputs
+                    // https://github.com/mapbox/geojson-vt/issues/104
+                    auto posToMid = std::abs(static_cast<int64_t>(i) - mid);
+                    if (posToMid < minPosToMid) {
+                        index = i;
+                        minPosToMid = posToMid;
+                    }
+                }
             }
         }
-    }
 
-    if (maxSqDist > sqTolerance) {
-        // save the point importance in squared pixels as a z coordinate
-        points[index].z = maxSqDist;
-        if (index - first > 1)
-            simplify(points, first, index, sqTolerance);
-        if (last - index > 1)
-            simplify(points, index, last, sqTolerance);
+        if (maxSqDist > sqTolerance) {
+            // save the point importance in squared pixels as a z coordinate
+            points[index].z = maxSqDist;
+            if (last - index > 1)
+                ranges.emplace_back(index, last);
+            if (index - first > 1)
+                ranges.emplace_back(first, index);
+        }
     }
 }
 
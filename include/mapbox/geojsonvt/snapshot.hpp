@@ -0,0 +1,782 @@
+#pragma once
+
+#include <mapbox/geojsonvt/tile.hpp>
+#include <mapbox/geojsonvt/types.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPBOX_GEOJSONVT_MMAP
+#endif
+
+namespace mapbox {
+namespace geojsonvt {
+namespace detail {
+
+// Snapshots are written in the byte order of the machine and are only meant to be read back by
+// the same build. Geometry and property maps that are shared between features are stored once, in
+// tables they're looked up in by index.
+constexpr char snapshot_magic[8] = { 'G', 'J', 'V', 'T', 'S', 'N', 'A', 'P' };
+constexpr uint32_t snapshot_version = 3;
+constexpr uint32_t snapshot_byte_order = 0x01020304;
+
+// arrays of points are written and read as they're laid out in memory
+static_assert(sizeof(vt_point) == 3 * sizeof(double) && std::is_trivially_copyable<vt_point>::value,
+              "points are x, y and z");
+
+class mapped_snapshot;
+
+class snapshot_writer {
+public:
+    std::string buffer;
+    // the squared tolerances of the zoom levels, to unpack packed source features with
+    std::vector<double> sqTolerances;
+    // the snapshot the index was loaded from, to read the source features it left there from
+    const mapped_snapshot* snapshot = nullptr;
+
+    void writeHeader() {
+        buffer.append(snapshot_magic, sizeof(snapshot_magic));
+        write(snapshot_version);
+        write(snapshot_byte_order);
+    }
+
+    template <class T>
+    void write(const T value) {
+        static_assert(std::is_arithmetic<T>::value, "only numbers are written as is");
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    void write(const std::string& string) {
+        write(uint64_t(string.size()));
+        buffer.append(string);
+    }
+
+    void write(const mapbox::geometry::box<double>& bbox) {
+        write(bbox.min.x);
+        write(bbox.min.y);
+        write(bbox.max.x);
+        write(bbox.max.y);
+    }
+
+    void write(const identifier& id) {
+        identifier::visit(id, identifier_writer{ *this });
+    }
+
+    void write(const property_map& properties) {
+        write(uint64_t(properties.size()));
+        for (const auto& pair : properties) {
+            write(pair.first);
+            value::visit(pair.second, value_writer{ *this });
+        }
+    }
+
+    void write(const vt_geometry& geometry) {
+        vt_geometry::visit(geometry, vt_geometry_writer{ *this });
+    }
+
+    // arrays of plain numbers or structs of them, in one piece
+    template <class T>
+    void writeArray(const std::vector<T>& items) {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain data is written as is");
+        write(uint64_t(items.size()));
+        buffer.append(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+    }
+
+    // shared geometry and properties go into tables as they're first written, and are referred to
+    // by index; the tables are inserted before what's been written from start on once it's all
+    // written
+    void insertTables(const std::size_t start) {
+        const std::string rest = buffer.substr(start);
+        buffer.resize(start);
+        writeTable(geometries);
+        writeTable(propertyMaps);
+        buffer += rest;
+    }
+
+    void write(const vt_feature& feature) {
+        write(index(geometries, *feature.geometry));
+        write(index(propertyMaps, *feature.properties));
+        write(feature.id);
+        write(feature.bbox);
+        write(feature.num_points);
+    }
+
+    // the features after their number and size, so that they can be skipped
+    void write(const vt_features& features) {
+        write(uint64_t(features.size()));
+        const std::size_t start = buffer.size();
+        write(uint64_t(0));
+        for (const auto& feature : features) {
+            write(feature);
+        }
+        const uint64_t length = buffer.size() - start - sizeof(uint64_t);
+        std::memcpy(&buffer[start], &length, sizeof(length));
+    }
+
+    // source features, or the ones left in the snapshot at mapped
+    void write(const vt_features& features, const uint64_t mapped);
+
+    // the output features are stored in their flat form, whether the tile has been built or not
+    void write(const FlatTile& flat) {
+        write(flat.num_points);
+        write(flat.num_simplified);
+        writeArray(flat.points);
+        writeArray(flat.ring_offsets);
+        writeArray(flat.part_offsets);
+        writeArray(flat.feature_offsets);
+        writeArray(flat.types);
+        for (const auto& id : flat.ids) {
+            write(id);
+        }
+        writeArray(flat.property_indices);
+        write(uint64_t(flat.properties.size()));
+        for (const auto& props : flat.properties) {
+            write(index(propertyMaps, *props));
+        }
+        writeArray(flat.clip_start);
+        writeArray(flat.clip_end);
+    }
+
+    void write(const InternalTile& tile) {
+        write(tile.z);
+        write(tile.x);
+        write(tile.y);
+        write(tile.bbox);
+        tile.withFlatTile([this](const FlatTile& flat) { write(flat); });
+        if (!tile.packed_source.empty())
+            write(keep(tile.packed_source.unpack(sqTolerances)));
+        else
+            write(tile.source_features, tile.mapped_source);
+    }
+
+private:
+    template <class T>
+    struct table {
+        // the index of each item, by address
+        std::unordered_map<const T*, uint64_t> indices;
+        std::string items;
+        std::vector<uint64_t> offsets;
+    };
+    table<vt_geometry> geometries;
+    table<property_map> propertyMaps;
+    // features unpacked or read for writing, which are kept until the end so that the addresses
+    // of their geometry and property maps aren't reused while they're in the tables
+    std::vector<vt_features> kept;
+
+    template <class T>
+    uint64_t index(table<T>& to, const T& item) {
+        const auto inserted = to.indices.emplace(&item, to.offsets.size());
+        if (inserted.second) {
+            to.offsets.push_back(to.items.size());
+            buffer.swap(to.items);
+            write(item);
+            buffer.swap(to.items);
+        }
+        return inserted.first->second;
+    }
+
+    // the size of the items, the items, and where each of them is
+    template <class T>
+    void writeTable(const table<T>& from) {
+        write(uint64_t(from.items.size()));
+        buffer += from.items;
+        writeArray(from.offsets);
+    }
+
+    const vt_features& keep(vt_features features) {
+        kept.push_back(std::move(features));
+        return kept.back();
+    }
+
+    struct identifier_writer {
+        snapshot_writer& writer;
+
+        void operator()(const null_value&) const {
+            writer.write(uint8_t(0));
+        }
+        void operator()(const uint64_t value) const {
+            writer.write(uint8_t(1));
+            writer.write(value);
+        }
+        void operator()(const int64_t value) const {
+            writer.write(uint8_t(2));
+            writer.write(value);
+        }
+        void operator()(const double value) const {
+            writer.write(uint8_t(3));
+            writer.write(value);
+        }
+        void operator()(const std::string& value) const {
+            writer.write(uint8_t(4));
+            writer.write(value);
+        }
+    };
+
+    struct value_writer {
+        snapshot_writer& writer;
+
+        void operator()(const null_value&) const {
+            writer.write(uint8_t(0));
+        }
+        void operator()(const bool value) const {
+            writer.write(uint8_t(1));
+            writer.write(uint8_t(value));
+        }
+        void operator()(const uint64_t value) const {
+            writer.write(uint8_t(2));
+            writer.write(value);
+        }
+        void operator()(const int64_t value) const {
+            writer.write(uint8_t(3));
+            writer.write(value);
+        }
+        void operator()(const double value) const {
+            writer.write(uint8_t(4));
+            writer.write(value);
+        }
+        void operator()(const std::string& value) const {
+            writer.write(uint8_t(5));
+            writer.write(value);
+        }
+        // vector tiles can't hold nested values either
+        template <class T>
+        void operator()(const T&) const {
+            throw std::runtime_error("Snapshots only support scalar property values");
+        }
+    };
+
+    struct vt_geometry_writer {
+        snapshot_writer& writer;
+
+        void points(const std::vector<vt_point>& points) const {
+            writer.write(uint64_t(points.size()));
+            writer.buffer.append(reinterpret_cast<const char*>(points.data()), points.size() * sizeof(vt_point));
+        }
+        void ring(const vt_linear_ring& ring) const {
+            writer.write(ring.area);
+            points(ring);
+        }
+        void line(const vt_line_string& line) const {
+            writer.write(line.dist);
+            writer.write(line.segStart);
+            writer.write(line.segEnd);
+            points(line);
+        }
+        void polygon(const vt_polygon& polygon) const {
+            writer.write(uint64_t(polygon.size()));
+            for (const auto& r : polygon) {
+                ring(r);
+            }
+        }
+
+        void operator()(const vt_empty&) const {
+            writer.write(uint8_t(0));
+        }
+        void operator()(const vt_point& point) const {
+            writer.write(uint8_t(1));
+            points({ point });
+        }
+        void operator()(const vt_line_string& l) const {
+            writer.write(uint8_t(2));
+            line(l);
+        }
+        void operator()(const vt_polygon& p) const {
+            writer.write(uint8_t(3));
+            polygon(p);
+        }
+        void operator()(const vt_multi_point& p) const {
+            writer.write(uint8_t(4));
+            points(p);
+        }
+        void operator()(const vt_multi_line_string& lines) const {
+            writer.write(uint8_t(5));
+            writer.write(uint64_t(lines.size()));
+            for (const auto& l : lines) {
+                line(l);
+            }
+        }
+        void operator()(const vt_multi_polygon& polygons) const {
+            writer.write(uint8_t(6));
+            writer.write(uint64_t(polygons.size()));
+            for (const auto& p : polygons) {
+                polygon(p);
+            }
+        }
+        void operator()(const vt_geometry_collection& collection) const {
+            writer.write(uint8_t(7));
+            writer.write(uint64_t(collection.size()));
+            for (const auto& geometry : collection) {
+                writer.write(geometry);
+            }
+        }
+    };
+
+};
+
+// the contents of a file, memory-mapped where that's available
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path) {
+#ifdef MAPBOX_GEOJSONVT_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Error opening file " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Error reading file " + path);
+        }
+        length = static_cast<std::size_t>(info.st_size);
+        if (length > 0) {
+            void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Error mapping file " + path);
+            }
+            address = static_cast<const char*>(mapped);
+        }
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::in | std::ios::binary);
+        if (!in)
+            throw std::runtime_error("Error opening file " + path);
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        buffer = contents.str();
+        address = buffer.data();
+        length = buffer.size();
+#endif
+    }
+
+    ~mapped_file() {
+#ifdef MAPBOX_GEOJSONVT_MMAP
+        if (address)
+            ::munmap(const_cast<char*>(address), length);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    const char* data() const {
+        return address;
+    }
+
+    std::size_t size() const {
+        return length;
+    }
+
+private:
+    const char* address = nullptr;
+    std::size_t length = 0;
+#ifndef MAPBOX_GEOJSONVT_MMAP
+    std::string buffer;
+#endif
+};
+
+class snapshot_reader;
+
+// A snapshot that stays mapped for as long as the index loaded from it. The source features of
+// its tiles are only read from it when the tiles are drilled down from, and the geometry and
+// property maps they refer to when they're first needed; those are shared for as long as they're
+// in use, like they are between the tiles of an index built in-process.
+class mapped_snapshot {
+public:
+    explicit mapped_snapshot(const std::string& path) : file(path) {
+    }
+
+    const mapped_file file;
+
+    // where the geometry and property maps in the tables are
+    void readTables(snapshot_reader& reader);
+
+    std::shared_ptr<const vt_geometry> geometry(const uint64_t index) const;
+    std::shared_ptr<const property_map> properties(const uint64_t index) const;
+
+    // the features at an offset snapshot_reader::skipFeatures returned
+    vt_features readFeatures(const uint64_t offset) const;
+
+private:
+    template <class T>
+    struct table {
+        std::vector<uint64_t> offsets;
+        // the items that have been read and are still in use
+        std::vector<std::weak_ptr<const T>> items;
+    };
+
+    // guards the items of the tables
+    mutable std::mutex mutex;
+    mutable table<vt_geometry> geometries;
+    mutable table<property_map> propertyMaps;
+
+    template <class T>
+    void readTable(snapshot_reader& reader, table<T>& result);
+
+    template <class T, class Read>
+    std::shared_ptr<const T> lookup(table<T>& from, const uint64_t index, const Read& read) const;
+};
+
+class snapshot_reader {
+public:
+    explicit snapshot_reader(const mapped_snapshot& snapshot_, const std::size_t pos_ = 0)
+        : snapshot(snapshot_), data(snapshot_.file.data()), size(snapshot_.file.size()), pos(pos_) {
+    }
+
+    void readHeader() {
+        if (size < sizeof(snapshot_magic) ||
+            std::memcmp(take(sizeof(snapshot_magic)), snapshot_magic, sizeof(snapshot_magic)) != 0)
+            throw std::runtime_error("Not a geojson-vt snapshot");
+        if (read<uint32_t>() != snapshot_version || read<uint32_t>() != snapshot_byte_order)
+            throw std::runtime_error("Unsupported snapshot version");
+    }
+
+    template <class T>
+    T read() {
+        static_assert(std::is_arithmetic<T>::value, "only numbers are read as is");
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string readString() {
+        const auto length = readSize();
+        return std::string(take(length), length);
+    }
+
+    mapbox::geometry::box<double> readBox() {
+        mapbox::geometry::box<double> bbox = { { 0, 0 }, { 0, 0 } };
+        bbox.min.x = read<double>();
+        bbox.min.y = read<double>();
+        bbox.max.x = read<double>();
+        bbox.max.y = read<double>();
+        return bbox;
+    }
+
+    identifier readIdentifier() {
+        switch (read<uint8_t>()) {
+        case 0:
+            return null_value{};
+        case 1:
+            return read<uint64_t>();
+        case 2:
+            return read<int64_t>();
+        case 3:
+            return read<double>();
+        case 4:
+            return readString();
+        default:
+            throw std::runtime_error("Invalid snapshot identifier");
+        }
+    }
+
+    value readValue() {
+        switch (read<uint8_t>()) {
+        case 0:
+            return null_value{};
+        case 1:
+            return bool(read<uint8_t>());
+        case 2:
+            return read<uint64_t>();
+        case 3:
+            return read<int64_t>();
+        case 4:
+            return read<double>();
+        case 5:
+            return readString();
+        default:
+            throw std::runtime_error("Invalid snapshot property value");
+        }
+    }
+
+    property_map readProperties() {
+        property_map properties;
+        const auto count = readSize();
+        properties.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            auto key = readString();
+            properties.emplace(std::move(key), readValue());
+        }
+        return properties;
+    }
+
+    vt_geometry readGeometry() {
+        switch (read<uint8_t>()) {
+        case 0:
+            return vt_empty{};
+        case 1: {
+            auto points = readPoints<vt_multi_point>();
+            if (points.size() != 1)
+                throw std::runtime_error("Invalid snapshot geometry");
+            return points[0];
+        }
+        case 2:
+            return readLine();
+        case 3:
+            return readPolygon();
+        case 4:
+            return readPoints<vt_multi_point>();
+        case 5:
+            return readParts<vt_multi_line_string>([this] { return readLine(); });
+        case 6:
+            return readParts<vt_multi_polygon>([this] { return readPolygon(); });
+        case 7:
+            return readParts<vt_geometry_collection>([this] { return readGeometry(); });
+        default:
+            throw std::runtime_error("Invalid snapshot geometry");
+        }
+    }
+
+    // skips a block of the given size, returning where it starts
+    std::size_t skip(const std::size_t length) {
+        const std::size_t start = pos;
+        take(length);
+        return start;
+    }
+
+    // skips the size of a block and the block, returning where it starts
+    std::size_t skipBlock() {
+        return skip(readSize());
+    }
+
+    vt_features readFeatures() {
+        vt_features features;
+        const auto count = readSize();
+        // their size, to skip them by
+        readSize();
+        features.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            const auto geometry = snapshot.geometry(read<uint64_t>());
+            const auto props = snapshot.properties(read<uint64_t>());
+            const auto id = readIdentifier();
+            const auto bbox = readBox();
+            const auto numPoints = read<uint32_t>();
+            features.emplace_back(geometry, props, id, bbox, numPoints);
+        }
+        return features;
+    }
+
+    // skips features, which are read when they're needed; returns where they are, or 0 if there
+    // are none
+    uint64_t skipFeatures() {
+        const std::size_t start = pos;
+        const auto count = readSize();
+        skipBlock();
+        return count ? start : 0;
+    }
+
+    FlatTile readFlatTile() {
+        FlatTile flat;
+        flat.num_points = read<uint32_t>();
+        flat.num_simplified = read<uint32_t>();
+        flat.points = readArray<mapbox::geometry::point<int16_t>>();
+        flat.ring_offsets = readArray<uint32_t>();
+        flat.part_offsets = readArray<uint32_t>();
+        flat.feature_offsets = readArray<uint32_t>();
+        flat.types = readArray<FlatTile::GeometryType>();
+        flat.ids.reserve(flat.types.size());
+        for (std::size_t i = 0; i < flat.types.size(); ++i) {
+            flat.ids.push_back(readIdentifier());
+        }
+        flat.property_indices = readArray<uint32_t>();
+        const auto count = readSize();
+        flat.properties.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            flat.properties.push_back(snapshot.properties(read<uint64_t>()));
+        }
+        flat.clip_start = readArray<double>();
+        flat.clip_end = readArray<double>();
+
+        if (!valid(flat))
+            throw std::runtime_error("Invalid snapshot tile");
+        return flat;
+    }
+
+    bool done() const {
+        return pos == size;
+    }
+
+    template <class T>
+    std::vector<T> readArray() {
+        const auto count = readSize();
+        const char* p = take(count * sizeof(T));
+        std::vector<T> items(count);
+        if (count)
+            std::memcpy(items.data(), p, count * sizeof(T));
+        return items;
+    }
+
+private:
+    const mapped_snapshot& snapshot;
+    const char* data;
+    const std::size_t size;
+    std::size_t pos;
+
+    const char* take(const std::size_t n) {
+        if (n > size - pos)
+            throw std::runtime_error("Truncated snapshot");
+        const char* result = data + pos;
+        pos += n;
+        return result;
+    }
+
+    // a count of items that take at least a byte each, checked so that a corrupt file can't make
+    // us reserve huge amounts of memory
+    std::size_t readSize() {
+        const auto n = read<uint64_t>();
+        if (n > size - pos)
+            throw std::runtime_error("Truncated snapshot");
+        return static_cast<std::size_t>(n);
+    }
+
+    // the file may not be aligned for doubles, so the points are copied rather than pointed at
+    template <class Points>
+    Points readPoints() {
+        const auto count = readSize();
+        const char* p = take(count * sizeof(vt_point));
+        Points points;
+        points.resize(count, { 0, 0 });
+        if (count)
+            std::memcpy(points.data(), p, count * sizeof(vt_point));
+        return points;
+    }
+
+    // offsets that start at 0, never decrease and end at the size of what they point into
+    static bool validOffsets(const std::vector<uint32_t>& offsets, const std::size_t size) {
+        return !offsets.empty() && offsets.front() == 0 && offsets.back() == size &&
+               std::is_sorted(offsets.begin(), offsets.end());
+    }
+
+    // the offsets are trusted when the output features are built, so they're checked here
+    static bool valid(const FlatTile& flat) {
+        const std::size_t n = flat.types.size();
+        if (!validOffsets(flat.ring_offsets, flat.points.size()) ||
+            !validOffsets(flat.part_offsets, flat.ring_offsets.size() - 1) ||
+            !validOffsets(flat.feature_offsets, flat.part_offsets.size() - 1) ||
+            flat.feature_offsets.size() != n + 1 || flat.property_indices.size() != n ||
+            flat.clip_start.size() != flat.clip_end.size() || (!flat.clip_start.empty() && flat.clip_start.size() != n))
+            return false;
+        for (std::size_t i = 0; i < n; ++i) {
+            if (flat.property_indices[i] >= flat.properties.size() || flat.types[i] > FlatTile::Polygon)
+                return false;
+            const uint32_t parts = flat.feature_offsets[i + 1] - flat.feature_offsets[i];
+            if ((flat.types[i] == FlatTile::Point && parts != 1) || (flat.types[i] != FlatTile::Unknown && parts == 0))
+                return false;
+            // points and lines have a ring in each part
+            if (flat.types[i] == FlatTile::Point || flat.types[i] == FlatTile::LineString) {
+                for (uint32_t part = flat.feature_offsets[i]; part < flat.feature_offsets[i + 1]; ++part) {
+                    if (flat.part_offsets[part + 1] - flat.part_offsets[part] != 1)
+                        return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    template <class Parts, class ReadPart>
+    Parts readParts(const ReadPart& readPart) {
+        Parts parts;
+        const auto count = readSize();
+        parts.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            parts.emplace_back(readPart());
+        }
+        return parts;
+    }
+
+    vt_line_string readLine() {
+        const double dist = read<double>();
+        const double segStart = read<double>();
+        const double segEnd = read<double>();
+        auto line = readPoints<vt_line_string>();
+        line.dist = dist;
+        line.segStart = segStart;
+        line.segEnd = segEnd;
+        return line;
+    }
+
+    vt_polygon readPolygon() {
+        return readParts<vt_polygon>([this] {
+            const double area = read<double>();
+            auto ring = readPoints<vt_linear_ring>();
+            ring.area = area;
+            return ring;
+        });
+    }
+};
+
+template <class T>
+void mapped_snapshot::readTable(snapshot_reader& reader, table<T>& result) {
+    const auto length = reader.read<uint64_t>();
+    const std::size_t start = reader.skip(length);
+    result.offsets = reader.readArray<uint64_t>();
+    for (auto& offset : result.offsets) {
+        if (offset >= length)
+            throw std::runtime_error("Invalid snapshot table");
+        offset += start;
+    }
+    result.items.resize(result.offsets.size());
+}
+
+inline void mapped_snapshot::readTables(snapshot_reader& reader) {
+    readTable(reader, geometries);
+    readTable(reader, propertyMaps);
+}
+
+template <class T, class Read>
+std::shared_ptr<const T>
+mapped_snapshot::lookup(table<T>& from, const uint64_t index, const Read& read) const {
+    if (index >= from.offsets.size())
+        throw std::runtime_error("Invalid snapshot table index");
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (auto item = from.items[index].lock())
+            return item;
+    }
+
+    // read without the lock, so that drill-downs from different tiles don't wait for each other;
+    // not with make_shared, whose single allocation would outlive the item for as long as the
+    // table refers to it
+    snapshot_reader reader(*this, from.offsets[index]);
+    std::shared_ptr<const T> item(new T(read(reader)));
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (auto other = from.items[index].lock())
+        return other;
+    from.items[index] = item;
+    return item;
+}
+
+inline std::shared_ptr<const vt_geometry> mapped_snapshot::geometry(const uint64_t index) const {
+    return lookup(geometries, index, [](snapshot_reader& reader) { return reader.readGeometry(); });
+}
+
+inline std::shared_ptr<const property_map> mapped_snapshot::properties(const uint64_t index) const {
+    return lookup(propertyMaps, index, [](snapshot_reader& reader) { return reader.readProperties(); });
+}
+
+inline vt_features mapped_snapshot::readFeatures(const uint64_t offset) const {
+    snapshot_reader reader(*this, offset);
+    return reader.readFeatures();
+}
+
+inline void snapshot_writer::write(const vt_features& features, const uint64_t mapped) {
+    write(mapped ? keep(snapshot->readFeatures(mapped)) : features);
+}
+
+} // namespace detail
+} // namespace geojsonvt
+} // namespace mapbox
@@ -1,7 +1,14 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+#include <mapbox/geojsonvt/packed.hpp>
 #include <mapbox/geojsonvt/types.hpp>
 
 namespace mapbox {
@@ -11,6 +18,66 @@ struct Tile {
     mapbox::feature::feature_collection<int16_t> features;
     uint32_t num_points = 0;
     uint32_t num_simplified = 0;
+    // with sharedProperties = true, the property maps of the features, which are left empty; they
+    // are shared with the source features rather than copied into every tile
+    std::vector<std::shared_ptr<const mapbox::feature::property_map>> properties;
+};
+
+// The features of a tile in flat arrays rather than nested vectors: the coordinates of all
+// features in one buffer, split into rings, parts and features by offset arrays. Points and lines
+// have a single ring in each part, polygons a part for each polygon.
+struct FlatTile {
+    enum GeometryType : uint8_t { Unknown = 0, Point = 1, LineString = 2, Polygon = 3 };
+
+    std::vector<mapbox::geometry::point<int16_t>> points;
+    // ring i is points[ring_offsets[i]] up to points[ring_offsets[i + 1]]
+    std::vector<uint32_t> ring_offsets = { 0 };
+    // part i is rings part_offsets[i] up to part_offsets[i + 1]
+    std::vector<uint32_t> part_offsets = { 0 };
+    // feature i is parts feature_offsets[i] up to feature_offsets[i + 1]
+    std::vector<uint32_t> feature_offsets = { 0 };
+
+    // of each feature
+    std::vector<GeometryType> types;
+    std::vector<mapbox::feature::identifier> ids;
+    std::vector<uint32_t> property_indices;
+    // line clip start and end, with lineMetrics = true; NaN for features that aren't clipped
+    // lines. Tile features have them as the mapbox_clip_start and mapbox_clip_end properties.
+    std::vector<double> clip_start;
+    std::vector<double> clip_end;
+
+    // property maps of the source features, shared with them
+    std::vector<std::shared_ptr<const mapbox::feature::property_map>> properties;
+
+    uint32_t num_points = 0;
+    uint32_t num_simplified = 0;
+
+    std::size_t size() const {
+        return types.size();
+    }
+};
+
+// estimated heap memory held by tiles, in bytes
+struct MemoryUsage {
+    // source features kept to generate the tiles below, with their geometry; not the ones left in
+    // the snapshot an index was loaded from, which are mapped rather than on the heap
+    std::size_t sourceFeatures = 0;
+    // output features and their geometry: the features waiting to be transformed, and the flat and
+    // the built form
+    std::size_t tileFeatures = 0;
+    // property maps copied into built output features
+    std::size_t properties = 0;
+
+    std::size_t total() const {
+        return sourceFeatures + tileFeatures + properties;
+    }
+
+    MemoryUsage& operator+=(const MemoryUsage& other) {
+        sourceFeatures += other.sourceFeatures;
+        tileFeatures += other.tileFeatures;
+        properties += other.properties;
+        return *this;
+    }
 };
 
 namespace detail {
@@ -26,19 +93,24 @@ public:
     const double tolerance;
     const double sq_tolerance;
     const bool lineMetrics;
+    const bool sharedProperties;
 
     vt_features source_features;
+    // the source features instead, with Options::compactSource
+    packed_features packed_source;
+    // or where they are in the snapshot the tile was loaded from, which they're read from when
+    // it's drilled down from; 0 if they're not there
+    uint64_t mapped_source = 0;
     mapbox::geometry::box<double> bbox = { { 2, 1 }, { -1, 0 } };
 
-    Tile tile;
-
     InternalTile(const vt_features& source,
                  const uint8_t z_,
                  const uint32_t x_,
                  const uint32_t y_,
                  const uint16_t extent_,
                  const double tolerance_,
-                 const bool lineMetrics_)
+                 const bool lineMetrics_,
+                 const bool sharedProperties_ = false)
         : extent(extent_),
           z(z_),
           x(x_),
@@ -46,21 +118,16 @@ public:
           z2(std::pow(2, z)),
           tolerance(tolerance_),
           sq_tolerance(tolerance_ * tolerance_),
-          lineMetrics(lineMetrics_) {
+          lineMetrics(lineMetrics_),
+          sharedProperties(sharedProperties_),
+          pending_features(source) {
 
-        tile.features.reserve(source.size());
+        // the split only needs the number of points and the bounds; the features are transformed
+        // into tile coordinates when the tile is first requested, or when it lets go of the source
+        // features they share their geometry with
         for (const auto& feature : source) {
-            const auto& geom = feature.geometry;
             assert(feature.properties);
-            const auto& props = feature.properties;
-            const auto& id = feature.id;
-
-            tile.num_points += feature.num_points;
-
-            vt_geometry::visit(geom, [&](const auto& g) {
-                // `this->` is a workaround for https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61636
-                this->addFeature(g, *props, id);
-            });
+            flat.num_points += feature.num_points;
 
             bbox.min.x = std::min(feature.bbox.min.x, bbox.min.x);
             bbox.min.y = std::min(feature.bbox.min.y, bbox.min.y);
@@ -69,141 +136,529 @@ public:
         }
     }
 
+    // a tile restored from a snapshot, whose features have been transformed already
+    InternalTile(FlatTile flat_,
+                 const mapbox::geometry::box<double>& bbox_,
+                 const uint8_t z_,
+                 const uint32_t x_,
+                 const uint32_t y_,
+                 const uint16_t extent_,
+                 const double tolerance_,
+                 const bool lineMetrics_,
+                 const bool sharedProperties_ = false)
+        : extent(extent_),
+          z(z_),
+          x(x_),
+          y(y_),
+          z2(std::pow(2, z)),
+          tolerance(tolerance_),
+          sq_tolerance(tolerance_ * tolerance_),
+          lineMetrics(lineMetrics_),
+          sharedProperties(sharedProperties_),
+          bbox(bbox_),
+          flat(std::move(flat_)) {
+        state->transformed.store(true, std::memory_order_relaxed);
+    }
+
+    // the features in flat arrays; they're transformed on the first call, or the first getTile,
+    // and flattened again from the output tile if it was built first and let go of them
+    const FlatTile& getFlatTile() const {
+        if (state->flatKept.load(std::memory_order_acquire))
+            return flat;
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->flatKept.load(std::memory_order_relaxed)) {
+            transformFeatures();
+            if (state->built.load(std::memory_order_relaxed))
+                flattenTile(flat);
+            state->flatKept.store(true, std::memory_order_release);
+        }
+        return flat;
+    }
+
+    // calls f with the flat features, transformed or flattened into a copy if the tile doesn't
+    // hold them yet, so that writing a snapshot leaves it with the forms it had
+    template <class F>
+    void withFlatTile(const F& f) const {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        const bool released = state->built.load(std::memory_order_relaxed) &&
+                              !state->flatKept.load(std::memory_order_relaxed);
+        if (state->transformed.load(std::memory_order_relaxed) && !released) {
+            f(flat);
+            return;
+        }
+        // what's left of the flat features of a built tile, or just the number of points
+        FlatTile copy = released ? flat : FlatTile();
+        if (released) {
+            flattenTile(copy);
+        } else {
+            copy.num_points = flat.num_points;
+            addFeatures(copy);
+        }
+        f(copy);
+    }
+
+    // transforms the features now, as the source features they share their geometry with are
+    // about to go; a tile that isn't requested then holds its output rather than the geometry
+    void transform() const {
+        if (state->transformed.load(std::memory_order_acquire))
+            return;
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        transformFeatures();
+    }
+
+    // the output tile; its features are only built from the flat ones on the first call, which
+    // copies their properties unless they're shared, so that tiles which are never requested
+    // don't pay for it. The flat geometry is let go of then, unless it's been requested too.
+    const Tile& getTile() const {
+        if (state->built.load(std::memory_order_acquire))
+            return tile;
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->built.load(std::memory_order_relaxed)) {
+            transformFeatures();
+            tile.features.reserve(flat.size());
+            if (sharedProperties)
+                tile.properties.reserve(flat.size());
+            for (std::size_t i = 0; i < flat.size(); ++i) {
+                const auto& properties = flat.properties[flat.property_indices[i]];
+                if (clipped(i)) {
+                    property_map props = *properties;
+                    props.emplace(std::make_pair<std::string, value>("mapbox_clip_start", flat.clip_start[i]));
+                    props.emplace(std::make_pair<std::string, value>("mapbox_clip_end", flat.clip_end[i]));
+                    if (sharedProperties) {
+                        tile.features.emplace_back(geometry(i), property_map(), flat.ids[i]);
+                        tile.properties.push_back(std::make_shared<const property_map>(std::move(props)));
+                    } else
+                        tile.features.emplace_back(geometry(i), std::move(props), flat.ids[i]);
+                } else if (sharedProperties) {
+                    tile.features.emplace_back(geometry(i), property_map(), flat.ids[i]);
+                    tile.properties.push_back(properties);
+                } else
+                    tile.features.emplace_back(geometry(i), *properties, flat.ids[i]);
+            }
+            tile.num_points = flat.num_points;
+            tile.num_simplified = flat.num_simplified;
+            if (!state->flatKept.load(std::memory_order_relaxed)) {
+                std::vector<mapbox::geometry::point<int16_t>>().swap(flat.points);
+                std::vector<uint32_t>().swap(flat.ring_offsets);
+                std::vector<uint32_t>().swap(flat.part_offsets);
+                std::vector<uint32_t>().swap(flat.feature_offsets);
+                std::vector<identifier>().swap(flat.ids);
+            }
+            state->built.store(true, std::memory_order_release);
+        }
+        return tile;
+    }
+
+    uint32_t numPoints() const {
+        return flat.num_points;
+    }
+
+    // whether the tile kept the source features to drill down from
+    bool hasSource() const {
+        return !source_features.empty() || !packed_source.empty() || mapped_source;
+    }
+
+    // whether the output tile has been built
+    bool isBuilt() const {
+        return state->built.load(std::memory_order_acquire);
+    }
+
+    // whether the flat features have been requested, so they're kept next to the output tile
+    bool isFlatKept() const {
+        return state->flatKept.load(std::memory_order_acquire);
+    }
+
 private:
-    void addFeature(const vt_empty& empty, const property_map& props, const identifier& id) {
-        tile.features.emplace_back(transform(empty), props, id);
+    friend MemoryUsage estimateMemory(const InternalTile&, std::unordered_set<const vt_geometry*>*);
+
+    // guards transforming the features and building the output tile; a unique_ptr keeps the tile
+    // movable
+    struct build_state {
+        std::mutex mutex;
+        std::atomic<bool> transformed{ false };
+        std::atomic<bool> built{ false };
+        std::atomic<bool> flatKept{ false };
+    };
+    std::unique_ptr<build_state> state = std::make_unique<build_state>();
+    // the features until they're transformed into flat; only kept while they share their geometry
+    // with the tile's source features
+    mutable vt_features pending_features;
+    mutable FlatTile flat;
+    mutable Tile tile;
+
+    // transforms the pending features into tile coordinates, if they aren't yet; called with the
+    // mutex held
+    void transformFeatures() const {
+        if (state->transformed.load(std::memory_order_relaxed))
+            return;
+
+        addFeatures(flat);
+        vt_features().swap(pending_features);
+        state->transformed.store(true, std::memory_order_release);
     }
 
-    void
-    addFeature(const vt_point& point, const property_map& props, const identifier& id) {
-        tile.features.emplace_back(transform(point), props, id);
+    // the pending features in tile coordinates
+    void addFeatures(FlatTile& out) const {
+        out.types.reserve(pending_features.size());
+        out.ids.reserve(pending_features.size());
+        out.property_indices.reserve(pending_features.size());
+        for (const auto& feature : pending_features) {
+            const auto& id = feature.id;
+
+            // features split from the same source feature share its property map
+            if (out.properties.empty() || out.properties.back() != feature.properties)
+                out.properties.push_back(feature.properties);
+            const auto props = uint32_t(out.properties.size() - 1);
+
+            vt_geometry::visit(*feature.geometry, [&](const auto& g) {
+                // `this->` is a workaround for https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61636
+                this->addFeature(out, g, props, id);
+            });
+        }
+    }
+
+    // the flat geometry and ids again from the output tile, which was built without keeping them;
+    // called with the mutex held
+    void flattenTile(FlatTile& out) const {
+        out.points.reserve(out.num_simplified);
+        out.ring_offsets = { 0 };
+        out.part_offsets = { 0 };
+        out.feature_offsets = { 0 };
+        out.ids.reserve(tile.features.size());
+        for (const auto& feature : tile.features) {
+            mapbox::geometry::geometry<int16_t>::visit(feature.geometry, [&](const auto& g) {
+                // `this->` is a workaround for https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61636
+                this->flattenGeometry(out, g);
+            });
+            out.feature_offsets.push_back(uint32_t(out.part_offsets.size() - 1));
+            out.ids.push_back(feature.id);
+        }
+    }
+
+    void flattenGeometry(FlatTile&, const mapbox::geometry::empty&) const {
+    }
+
+    void flattenGeometry(FlatTile& out, const mapbox::geometry::point<int16_t>& point) const {
+        out.points.push_back(point);
+        endRing(out);
+        endPart(out);
+    }
+
+    template <class Points>
+    void flattenRing(FlatTile& out, const Points& points) const {
+        out.points.insert(out.points.end(), points.begin(), points.end());
+        endRing(out);
+    }
+
+    void flattenGeometry(FlatTile& out, const mapbox::geometry::multi_point<int16_t>& points) const {
+        flattenRing(out, points);
+        endPart(out);
     }
 
-    void addFeature(const vt_line_string& line,
-                    const property_map& props,
-                    const identifier& id) {
-        const auto new_line = transform(line);
-        if (!new_line.empty()) {
-            if (lineMetrics) {
-                property_map newProps = props;
-                newProps.emplace(std::make_pair<std::string, value>("mapbox_clip_start", line.segStart / line.dist));
-                newProps.emplace(std::make_pair<std::string, value>("mapbox_clip_end", line.segEnd / line.dist));
-                tile.features.emplace_back(std::move(new_line), std::move(newProps), id);
-            } else
-                tile.features.emplace_back(std::move(new_line), props, id);
+    void flattenGeometry(FlatTile& out, const mapbox::geometry::line_string<int16_t>& line) const {
+        flattenRing(out, line);
+        endPart(out);
+    }
+
+    void flattenGeometry(FlatTile& out, const mapbox::geometry::multi_line_string<int16_t>& lines) const {
+        for (const auto& line : lines) {
+            flattenGeometry(out, line);
         }
     }
 
-    void addFeature(const vt_polygon& polygon,
-                    const property_map& props,
-                    const identifier& id) {
-        const auto new_polygon = transform(polygon);
-        if (!new_polygon.empty())
-            tile.features.emplace_back(std::move(new_polygon), props, id);
+    void flattenGeometry(FlatTile& out, const mapbox::geometry::polygon<int16_t>& polygon) const {
+        for (const auto& ring : polygon) {
+            flattenRing(out, ring);
+        }
+        endPart(out);
     }
 
-    void addFeature(const vt_geometry_collection& collection,
-                    const property_map& props,
-                    const identifier& id) {
+    void flattenGeometry(FlatTile& out, const mapbox::geometry::multi_polygon<int16_t>& polygons) const {
+        for (const auto& polygon : polygons) {
+            flattenGeometry(out, polygon);
+        }
+    }
+
+    void flattenGeometry(FlatTile& out,
+                         const mapbox::geometry::geometry_collection<int16_t>& collection) const {
         for (const auto& geom : collection) {
-            vt_geometry::visit(geom, [&](const auto& g) {
+            mapbox::geometry::geometry<int16_t>::visit(geom, [&](const auto& g) {
                 // `this->` is a workaround for https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61636
-                this->addFeature(g, props, id);
+                this->flattenGeometry(out, g);
             });
         }
     }
 
-    template <class T>
-    void addFeature(const T& multi, const property_map& props, const identifier& id) {
-        const auto new_multi = transform(multi);
+    // whether a feature is a clipped line with line metrics
+    bool clipped(const std::size_t i) const {
+        return !flat.clip_start.empty() && !std::isnan(flat.clip_start[i]);
+    }
+
+    // the nested geometry of a flat feature; parts with a single ring or point are unwrapped the
+    // way the features were before they were transformed
+    mapbox::geometry::geometry<int16_t> geometry(const std::size_t i) const {
+        const uint32_t firstPart = flat.feature_offsets[i];
+        const uint32_t lastPart = flat.feature_offsets[i + 1];
+
+        const auto points = [&](const uint32_t ring, auto result) {
+            result.assign(flat.points.begin() + flat.ring_offsets[ring],
+                          flat.points.begin() + flat.ring_offsets[ring + 1]);
+            return result;
+        };
+        const auto polygon = [&](const uint32_t part) {
+            mapbox::geometry::polygon<int16_t> result;
+            result.reserve(flat.part_offsets[part + 1] - flat.part_offsets[part]);
+            for (uint32_t ring = flat.part_offsets[part]; ring < flat.part_offsets[part + 1]; ++ring) {
+                result.push_back(points(ring, mapbox::geometry::linear_ring<int16_t>()));
+            }
+            return result;
+        };
 
-        switch (new_multi.size()) {
-        case 0:
-            break;
-        case 1:
-            tile.features.emplace_back(std::move(new_multi[0]), props, id);
-            break;
+        switch (flat.types[i]) {
+        case FlatTile::Point: {
+            const uint32_t ring = flat.part_offsets[firstPart];
+            if (flat.ring_offsets[ring + 1] - flat.ring_offsets[ring] == 1)
+                return flat.points[flat.ring_offsets[ring]];
+            return points(ring, mapbox::geometry::multi_point<int16_t>());
+        }
+        case FlatTile::LineString: {
+            if (lastPart - firstPart == 1)
+                return points(flat.part_offsets[firstPart], mapbox::geometry::line_string<int16_t>());
+            mapbox::geometry::multi_line_string<int16_t> result;
+            result.reserve(lastPart - firstPart);
+            for (uint32_t part = firstPart; part < lastPart; ++part) {
+                result.push_back(points(flat.part_offsets[part], mapbox::geometry::line_string<int16_t>()));
+            }
+            return result;
+        }
+        case FlatTile::Polygon: {
+            if (lastPart - firstPart == 1)
+                return polygon(firstPart);
+            mapbox::geometry::multi_polygon<int16_t> result;
+            result.reserve(lastPart - firstPart);
+            for (uint32_t part = firstPart; part < lastPart; ++part) {
+                result.push_back(polygon(part));
+            }
+            return result;
+        }
         default:
-            tile.features.emplace_back(std::move(new_multi), props, id);
-            break;
+            return mapbox::geometry::empty();
         }
     }
 
-    mapbox::geometry::empty transform(const vt_empty& empty) {
-        return empty;
+    void addFeature(FlatTile& out, const vt_empty&, const uint32_t props, const identifier& id) const {
+        endFeature(out, FlatTile::Unknown, props, id);
+    }
+
+    void addFeature(FlatTile& out, const vt_point& point, const uint32_t props, const identifier& id) const {
+        addPoint(out, point);
+        endRing(out);
+        endPart(out);
+        endFeature(out, FlatTile::Point, props, id);
     }
 
-    mapbox::geometry::point<int16_t> transform(const vt_point& p) {
-        ++tile.num_simplified;
-        return { static_cast<int16_t>(::round((p.x * z2 - x) * extent)),
-                 static_cast<int16_t>(::round((p.y * z2 - y) * extent)) };
+    void addFeature(FlatTile& out,
+                    const vt_line_string& line,
+                    const uint32_t props,
+                    const identifier& id) const {
+        if (!addLine(out, line))
+            return;
+        if (lineMetrics)
+            endFeature(out, FlatTile::LineString, props, id, line.segStart / line.dist,
+                       line.segEnd / line.dist);
+        else
+            endFeature(out, FlatTile::LineString, props, id);
     }
 
-    mapbox::geometry::multi_point<int16_t> transform(const vt_multi_point& points) {
-        mapbox::geometry::multi_point<int16_t> result;
-        result.reserve(points.size());
+    void addFeature(FlatTile& out,
+                    const vt_polygon& polygon,
+                    const uint32_t props,
+                    const identifier& id) const {
+        if (addPolygon(out, polygon))
+            endFeature(out, FlatTile::Polygon, props, id);
+    }
+
+    void addFeature(FlatTile& out,
+                    const vt_geometry_collection& collection,
+                    const uint32_t props,
+                    const identifier& id) const {
+        for (const auto& geom : collection) {
+            vt_geometry::visit(geom, [&](const auto& g) {
+                // `this->` is a workaround for https://gcc.gnu.org/bugzilla/show_bug.cgi?id=61636
+                this->addFeature(out, g, props, id);
+            });
+        }
+    }
+
+    void addFeature(FlatTile& out,
+                    const vt_multi_point& points,
+                    const uint32_t props,
+                    const identifier& id) const {
+        if (points.empty())
+            return;
         for (const auto& p : points) {
-            result.emplace_back(transform(p));
+            addPoint(out, p);
         }
-        return result;
+        endRing(out);
+        endPart(out);
+        endFeature(out, FlatTile::Point, props, id);
     }
 
-    mapbox::geometry::line_string<int16_t> transform(const vt_line_string& line) {
-        mapbox::geometry::line_string<int16_t> result;
-        if (line.dist > tolerance) {
-            result.reserve(line.size());
-            for (const auto& p : line) {
-                if (p.z > sq_tolerance)
-                    result.emplace_back(transform(p));
+    void addFeature(FlatTile& out,
+                    const vt_multi_line_string& lines,
+                    const uint32_t props,
+                    const identifier& id) const {
+        const auto parts = out.part_offsets.size();
+        for (const auto& line : lines) {
+            if (line.dist > tolerance) {
+                addRing(out, line);
+                endPart(out);
             }
         }
-        return result;
+        if (out.part_offsets.size() > parts)
+            endFeature(out, FlatTile::LineString, props, id);
     }
 
-    mapbox::geometry::linear_ring<int16_t> transform(const vt_linear_ring& ring) {
-        mapbox::geometry::linear_ring<int16_t> result;
-        if (ring.area > sq_tolerance) {
-            result.reserve(ring.size());
-            for (const auto& p : ring) {
-                if (p.z > sq_tolerance)
-                    result.emplace_back(transform(p));
-            }
+    void addFeature(FlatTile& out,
+                    const vt_multi_polygon& polygons,
+                    const uint32_t props,
+                    const identifier& id) const {
+        const auto parts = out.part_offsets.size();
+        for (const auto& polygon : polygons) {
+            addPolygon(out, polygon);
         }
-        return result;
+        if (out.part_offsets.size() > parts)
+            endFeature(out, FlatTile::Polygon, props, id);
     }
 
-    mapbox::geometry::multi_line_string<int16_t> transform(const vt_multi_line_string& lines) {
-        mapbox::geometry::multi_line_string<int16_t> result;
-        result.reserve(lines.size());
-        for (const auto& line : lines) {
-            if (line.dist > tolerance)
-                result.emplace_back(transform(line));
+    void addPoint(FlatTile& out, const vt_point& p) const {
+        ++out.num_simplified;
+        out.points.push_back({ static_cast<int16_t>(::round((p.x * z2 - x) * extent)),
+                               static_cast<int16_t>(::round((p.y * z2 - y) * extent)) });
+    }
+
+    // the points of a line or ring that are kept at this zoom
+    template <class Points>
+    void addRing(FlatTile& out, const Points& points) const {
+        for (const auto& p : points) {
+            if (p.z > sq_tolerance)
+                addPoint(out, p);
+        }
+        endRing(out);
+    }
+
+    bool addLine(FlatTile& out, const vt_line_string& line) const {
+        if (line.dist <= tolerance)
+            return false;
+        const auto start = out.points.size();
+        addRing(out, line);
+        if (out.points.size() == start) {
+            out.ring_offsets.pop_back();
+            return false;
         }
-        return result;
+        endPart(out);
+        return true;
     }
 
-    mapbox::geometry::polygon<int16_t> transform(const vt_polygon& rings) {
-        mapbox::geometry::polygon<int16_t> result;
-        result.reserve(rings.size());
+    bool addPolygon(FlatTile& out, const vt_polygon& rings) const {
+        const auto start = out.ring_offsets.size();
         for (const auto& ring : rings) {
             if (ring.area > sq_tolerance)
-                result.emplace_back(transform(ring));
+                addRing(out, ring);
         }
-        return result;
+        if (out.ring_offsets.size() == start)
+            return false;
+        endPart(out);
+        return true;
     }
 
-    mapbox::geometry::multi_polygon<int16_t> transform(const vt_multi_polygon& polygons) {
-        mapbox::geometry::multi_polygon<int16_t> result;
-        result.reserve(polygons.size());
-        for (const auto& polygon : polygons) {
-            const auto p = transform(polygon);
-            if (!p.empty())
-                result.emplace_back(std::move(p));
+    void endRing(FlatTile& out) const {
+        out.ring_offsets.push_back(uint32_t(out.points.size()));
+    }
+
+    void endPart(FlatTile& out) const {
+        out.part_offsets.push_back(uint32_t(out.ring_offsets.size() - 1));
+    }
+
+    void endFeature(FlatTile& out,
+                    const FlatTile::GeometryType type,
+                    const uint32_t props,
+                    const identifier& id,
+                    const double clipStart = std::numeric_limits<double>::quiet_NaN(),
+                    const double clipEnd = std::numeric_limits<double>::quiet_NaN()) const {
+        out.feature_offsets.push_back(uint32_t(out.part_offsets.size() - 1));
+        out.types.push_back(type);
+        out.ids.push_back(id);
+        out.property_indices.push_back(props);
+        if (lineMetrics) {
+            out.clip_start.push_back(clipStart);
+            out.clip_end.push_back(clipEnd);
         }
-        return result;
     }
 };
 
+// rough estimate of the heap memory held by a tile, used for Options::maxCacheBytes
+inline std::size_t estimateSize(const property_map& props) {
+    // hash node with the key/value pair, plus the capacity of its strings
+    std::size_t bytes = 0;
+    for (const auto& pair : props) {
+        bytes += sizeof(pair) + 2 * sizeof(void*) + pair.first.capacity();
+        if (pair.second.is<std::string>())
+            bytes += pair.second.get<std::string>().capacity();
+    }
+    return bytes;
+}
+
+// source geometry may be shared with other tiles; it's only counted if it isn't in counted yet,
+// and counted in full without a set
+inline MemoryUsage estimateMemory(const InternalTile& tile,
+                                  std::unordered_set<const vt_geometry*>* counted = nullptr) {
+    MemoryUsage usage;
+    for (const auto& feature : tile.source_features) {
+        usage.sourceFeatures += sizeof(feature);
+        if (!counted || counted->insert(feature.geometry.get()).second)
+            usage.sourceFeatures += feature.num_points * sizeof(vt_point);
+    }
+    usage.sourceFeatures += tile.packed_source.memory();
+
+    // the tile may be transformed or built by a concurrent request
+    std::lock_guard<std::mutex> lock(tile.state->mutex);
+    for (const auto& feature : tile.pending_features) {
+        usage.tileFeatures += sizeof(feature);
+        // the geometry is the source features' if the tile kept them
+        if (counted ? counted->insert(feature.geometry.get()).second : tile.source_features.empty())
+            usage.tileFeatures += feature.num_points * sizeof(vt_point);
+    }
+
+    const auto& flat = tile.flat;
+    usage.tileFeatures += flat.points.capacity() * sizeof(flat.points[0]) +
+                          (flat.ring_offsets.capacity() + flat.part_offsets.capacity() +
+                           flat.feature_offsets.capacity() + flat.property_indices.capacity()) * sizeof(uint32_t) +
+                          flat.types.capacity() * sizeof(FlatTile::GeometryType) +
+                          flat.ids.capacity() * sizeof(identifier) +
+                          (flat.clip_start.capacity() + flat.clip_end.capacity()) * sizeof(double) +
+                          flat.properties.capacity() * sizeof(flat.properties[0]);
+
+    if (tile.state->built.load(std::memory_order_relaxed)) {
+        usage.tileFeatures += tile.tile.features.capacity() * sizeof(tile.tile.features[0]) +
+                              tile.tile.properties.capacity() * sizeof(tile.tile.properties[0]) +
+                              flat.num_simplified * sizeof(mapbox::geometry::point<int16_t>);
+        // the copies the build made; shared maps belong to the source features
+        for (std::size_t i = 0; i < flat.size(); ++i) {
+            if (!tile.sharedProperties || tile.clipped(i))
+                usage.properties += estimateSize(*flat.properties[flat.property_indices[i]]);
+        }
+    }
+    return usage;
+}
+
+inline std::size_t estimateSize(const InternalTile& tile) {
+    return estimateMemory(tile).total();
+}
+
 } // namespace detail
 } // namespace geojsonvt
 } // namespace mapbox
@@ -0,0 +1,301 @@
+#pragma once
+
+#include <mapbox/geojsonvt/tile.hpp>
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace mapbox {
+namespace geojsonvt {
+namespace detail {
+
+// Tiles by id, in an open-addressing hash table with linear probing. Tiles are stored in blocks
+// that never move, so references to them stay valid until they're erased, like with
+// std::unordered_map, but lookups only probe a flat array of ids.
+class tile_store {
+public:
+    using key_type = uint64_t;
+    using mapped_type = InternalTile;
+    using value_type = std::pair<const uint64_t, InternalTile>;
+
+private:
+    struct slot {
+        uint64_t id;
+        value_type* value;
+    };
+
+public:
+    template <class Value>
+    class basic_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = tile_store::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = Value*;
+        using reference = Value&;
+
+        basic_iterator() = default;
+
+        // iterator to const_iterator
+        template <class Other, class = std::enable_if_t<std::is_convertible<Other*, Value*>::value>>
+        basic_iterator(const basic_iterator<Other>& other) : slot(other.slot), end(other.end) {
+        }
+
+        reference operator*() const {
+            return *slot->value;
+        }
+        pointer operator->() const {
+            return slot->value;
+        }
+
+        basic_iterator& operator++() {
+            ++slot;
+            skip();
+            return *this;
+        }
+        basic_iterator operator++(int) {
+            auto result = *this;
+            ++*this;
+            return result;
+        }
+
+        friend bool operator==(const basic_iterator& a, const basic_iterator& b) {
+            return a.slot == b.slot;
+        }
+        friend bool operator!=(const basic_iterator& a, const basic_iterator& b) {
+            return a.slot != b.slot;
+        }
+
+    private:
+        friend class tile_store;
+        template <class>
+        friend class basic_iterator;
+
+        using slot_pointer =
+            std::conditional_t<std::is_const<Value>::value, const tile_store::slot*, tile_store::slot*>;
+
+        basic_iterator(slot_pointer slot_, slot_pointer end_) : slot(slot_), end(end_) {
+        }
+
+        void skip() {
+            while (slot != end && !slot->value) {
+                ++slot;
+            }
+        }
+
+        slot_pointer slot = nullptr;
+        slot_pointer end = nullptr;
+    };
+
+    using iterator = basic_iterator<value_type>;
+    using const_iterator = basic_iterator<const value_type>;
+
+    tile_store() = default;
+    tile_store(const tile_store&) = delete;
+    tile_store& operator=(const tile_store&) = delete;
+
+    ~tile_store() {
+        clear();
+    }
+
+    std::size_t size() const {
+        return count_;
+    }
+
+    bool empty() const {
+        return count_ == 0;
+    }
+
+    iterator begin() {
+        iterator it{ slots.data(), slots.data() + slots.size() };
+        it.skip();
+        return it;
+    }
+    iterator end() {
+        return { slots.data() + slots.size(), slots.data() + slots.size() };
+    }
+    const_iterator begin() const {
+        const_iterator it{ slots.data(), slots.data() + slots.size() };
+        it.skip();
+        return it;
+    }
+    const_iterator end() const {
+        return { slots.data() + slots.size(), slots.data() + slots.size() };
+    }
+
+    iterator find(const uint64_t id) {
+        const std::size_t i = position(id);
+        return i == npos ? end() : iterator{ &slots[i], slots.data() + slots.size() };
+    }
+    const_iterator find(const uint64_t id) const {
+        const std::size_t i = position(id);
+        return i == npos ? end() : const_iterator{ &slots[i], slots.data() + slots.size() };
+    }
+
+    std::size_t count(const uint64_t id) const {
+        return position(id) == npos ? 0 : 1;
+    }
+
+    InternalTile& at(const uint64_t id) {
+        const std::size_t i = position(id);
+        if (i == npos)
+            throw std::out_of_range("tile_store::at");
+        return slots[i].value->second;
+    }
+    const InternalTile& at(const uint64_t id) const {
+        const std::size_t i = position(id);
+        if (i == npos)
+            throw std::out_of_range("tile_store::at");
+        return slots[i].value->second;
+    }
+
+    // whether any tile of zoom z is stored
+    bool hasZoom(const uint8_t z) const {
+        return z < zooms.size() && zooms[z] > 0;
+    }
+
+    std::pair<iterator, bool> emplace(const uint64_t id, InternalTile&& tile) {
+        std::size_t i = position(id);
+        if (i != npos)
+            return { iterator{ &slots[i], slots.data() + slots.size() }, false };
+
+        if ((count_ + 1) * 4 > slots.size() * 3)
+            grow();
+
+        value_type* value = allocate();
+        try {
+            new (value) value_type(id, std::move(tile));
+        } catch (...) {
+            free.push_back(value);
+            throw;
+        }
+
+        i = home(id);
+        while (slots[i].value) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = { id, value };
+        ++count_;
+        if (value->second.z >= zooms.size())
+            zooms.resize(value->second.z + 1);
+        ++zooms[value->second.z];
+
+        return { iterator{ &slots[i], slots.data() + slots.size() }, true };
+    }
+
+    std::size_t erase(const uint64_t id) {
+        std::size_t i = position(id);
+        if (i == npos)
+            return 0;
+
+        value_type* value = slots[i].value;
+        --zooms[value->second.z];
+        value->~value_type();
+        free.push_back(value);
+        --count_;
+
+        // shift back the entries after it that would otherwise no longer be found
+        std::size_t j = i;
+        while (true) {
+            j = (j + 1) & mask;
+            if (!slots[j].value)
+                break;
+            const std::size_t k = home(slots[j].id);
+            if (((j - k) & mask) >= ((j - i) & mask)) {
+                slots[i] = slots[j];
+                i = j;
+            }
+        }
+        slots[i] = {};
+        return 1;
+    }
+
+    void clear() {
+        for (auto& s : slots) {
+            if (s.value) {
+                s.value->~value_type();
+                s = {};
+            }
+        }
+        count_ = 0;
+        zooms.clear();
+        free.clear();
+        blocks.clear();
+        used = block_size;
+    }
+
+private:
+    using storage = std::aligned_storage_t<sizeof(value_type), alignof(value_type)>;
+
+    static constexpr std::size_t npos = std::size_t(-1);
+    static constexpr std::size_t block_size = 64;
+
+    std::vector<slot> slots;
+    std::size_t mask = 0;
+    // 64 - log2 of the number of slots
+    unsigned shift = 64;
+    std::size_t count_ = 0;
+    // number of tiles of each zoom
+    std::vector<uint32_t> zooms;
+
+    std::vector<std::unique_ptr<storage[]>> blocks;
+    // slots in the last block that have been handed out
+    std::size_t used = block_size;
+    // slots of erased tiles
+    std::vector<value_type*> free;
+
+    std::size_t home(const uint64_t id) const {
+        // Fibonacci hashing, which spreads the ids of neighbouring tiles over the whole table
+        return std::size_t((id * 0x9E3779B97F4A7C15ull) >> shift);
+    }
+
+    std::size_t position(const uint64_t id) const {
+        if (slots.empty())
+            return npos;
+        for (std::size_t i = home(id);; i = (i + 1) & mask) {
+            if (!slots[i].value)
+                return npos;
+            if (slots[i].id == id)
+                return i;
+        }
+    }
+
+    void grow() {
+        shift = slots.empty() ? 60 : shift - 1;
+        std::vector<slot> old(std::size_t(1) << (64 - shift), slot{ 0, nullptr });
+        old.swap(slots);
+        mask = slots.size() - 1;
+        for (const auto& s : old) {
+            if (!s.value)
+                continue;
+            std::size_t i = home(s.id);
+            while (slots[i].value) {
+                i = (i + 1) & mask;
+            }
+            slots[i] = s;
+        }
+    }
+
+    value_type* allocate() {
+        if (!free.empty()) {
+            value_type* value = free.back();
+            free.pop_back();
+            return value;
+        }
+        if (used == block_size) {
+            blocks.emplace_back(new storage[block_size]);
+            used = 0;
+        }
+        return reinterpret_cast<value_type*>(&blocks.back()[used++]);
+    }
+};
+
+} // namespace detail
+} // namespace geojsonvt
+} // namespace mapbox
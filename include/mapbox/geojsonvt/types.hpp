@@ -158,27 +158,41 @@ struct vt_geometry_type<geometry::geometry_collection<double>> {
 };
 
 struct vt_feature {
-    vt_geometry geometry;
+    // shared between the tiles a feature is passed down to unclipped; a modified geometry has to
+    // be copied into a new one
+    std::shared_ptr<const vt_geometry> geometry;
     std::shared_ptr<const property_map> properties;
     identifier id;
 
     mapbox::geometry::box<double> bbox = { { 2, 1 }, { -1, 0 } };
     uint32_t num_points = 0;
 
-    vt_feature(const vt_geometry& geom, std::shared_ptr<const property_map> props, const identifier& id_)
-        : geometry(geom), properties(std::move(props)), id(id_) {
+    vt_feature(vt_geometry geom, std::shared_ptr<const property_map> props, const identifier& id_)
+        : geometry(std::make_shared<const vt_geometry>(std::move(geom))), properties(std::move(props)), id(id_) {
         assert(properties);
         processGeometry();
     }
 
-    vt_feature(const vt_geometry& geom, const property_map& props, const identifier& id_)
-        : geometry(geom), properties(std::make_shared<property_map>(props)), id(id_) {
+    // a feature whose bbox and number of points are known already
+    vt_feature(std::shared_ptr<const vt_geometry> geom,
+               std::shared_ptr<const property_map> props,
+               const identifier& id_,
+               const mapbox::geometry::box<double>& bbox_,
+               const uint32_t num_points_)
+        : geometry(std::move(geom)), properties(std::move(props)), id(id_), bbox(bbox_), num_points(num_points_) {
+        assert(geometry && properties);
+    }
+
+    vt_feature(vt_geometry geom, const property_map& props, const identifier& id_)
+        : geometry(std::make_shared<const vt_geometry>(std::move(geom))),
+          properties(std::make_shared<property_map>(props)),
+          id(id_) {
         processGeometry();
     }
 
 private:
     void processGeometry() {
-        mapbox::geometry::for_each_point(geometry, [&](const vt_point& p) {
+        mapbox::geometry::for_each_point(*geometry, [&](const vt_point& p) {
             bbox.min.x = std::min(p.x, bbox.min.x);
             bbox.min.y = std::min(p.y, bbox.min.y);
             bbox.max.x = std::max(p.x, bbox.max.x);
@@ -190,6 +204,21 @@ private:
 
 using vt_features = std::vector<vt_feature>;
 
+struct identifier_hash {
+    std::size_t operator()(const null_value&) const {
+        return 0;
+    }
+
+    template <class T>
+    std::size_t operator()(const T& value) const {
+        return std::hash<T>()(value);
+    }
+
+    std::size_t operator()(const identifier& id) const {
+        return identifier::visit(id, *this);
+    }
+};
+
 } // namespace detail
 } // namespace geojsonvt
 } // namespace mapbox
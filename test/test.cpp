@@ -5,14 +5,23 @@
 #include <mapbox/geojsonvt.hpp>
 #include <mapbox/geojsonvt/clip.hpp>
 #include <mapbox/geojsonvt/convert.hpp>
+#include <mapbox/geojsonvt/reader.hpp>
 #include <mapbox/geojsonvt/simplify.hpp>
 #include <mapbox/geojsonvt/tile.hpp>
+#include <mapbox/geojsonvt/tile_store.hpp>
 #include <mapbox/geometry.hpp>
 
 #include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <random>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 #include <algorithm>
 
@@ -82,6 +91,89 @@ TEST(Simplify, Points) {
     ASSERT_EQ(result, simplified);
 }
 
+TEST(Simplify, SegmentDistances) {
+    // points before, along, past and level with the ends of segments, one of them of zero length
+    const std::vector<detail::vt_point> points = { { 0, 0 },   { -1, 2 }, { 0.3, 0.1 }, { 1, 1 },
+                                                   { 2, -1 },  { 5, 5 },  { -3, -3 },   { 0.5, 0.5 },
+                                                   { 1e-9, 0 } };
+    const std::vector<std::pair<detail::vt_point, detail::vt_point>> segments = {
+        { { 0, 0 }, { 1, 1 } }, { { 0.2, 0.7 }, { -0.4, 0.1 } }, { { 0.5, 0.5 }, { 0.5, 0.5 } }
+    };
+    std::vector<double> sqDists(points.size());
+    for (const auto& segment : segments) {
+        detail::getSqSegDists(points.data(), points.size(), segment.first, segment.second, sqDists.data());
+        for (size_t i = 0; i < points.size(); ++i) {
+            ASSERT_EQ(sqDists[i], detail::getSqSegDist(points[i], segment.first, segment.second));
+        }
+    }
+}
+
+namespace {
+
+// the recursive simplification the iterative one replaced, to compare with
+void simplifyRecursive(std::vector<detail::vt_point>& points, size_t first, size_t last, double sqTolerance) {
+    double maxSqDist = sqTolerance;
+    size_t index = 0;
+    const int64_t mid = first + ((last - first) >> 1);
+    int64_t minPosToMid = last - first;
+
+    for (auto i = first + 1; i < last; i++) {
+        const double sqDist = detail::getSqSegDist(points[i], points[first], points[last]);
+
+        if (sqDist > maxSqDist) {
+            index = i;
+            maxSqDist = sqDist;
+
+        } else if (sqDist == maxSqDist) {
+            auto posToMid = std::abs(static_cast<int64_t>(i) - mid);
+            if (posToMid < minPosToMid) {
+                index = i;
+                minPosToMid = posToMid;
+            }
+        }
+    }
+
+    if (maxSqDist > sqTolerance) {
+        points[index].z = maxSqDist;
+        if (index - first > 1)
+            simplifyRecursive(points, first, index, sqTolerance);
+        if (last - index > 1)
+            simplifyRecursive(points, index, last, sqTolerance);
+    }
+}
+
+} // namespace
+
+TEST(Simplify, Ties) {
+    // lines of over a thousand points on a grid of powers of two, so that many points are exactly
+    // as far from a segment and the pivot is the one closest to the middle: a zigzag, collinear runs
+    // between steps, and a mix of the two
+    const std::vector<std::function<double(size_t)>> shapes = {
+        [](size_t i) { return double(i % 2); },
+        [](size_t i) { return i % 64 < 32 ? 0.0 : 1.0; },
+        [](size_t i) { return i % 5 == 2 ? 1.0 : i % 3 == 1 ? -1.0 : 0.0; },
+    };
+    const size_t last = 1024;
+    for (const auto& shape : shapes) {
+        for (const double sqTolerance : { 0.0, 0.25 }) {
+            std::vector<detail::vt_point> points;
+            for (size_t i = 0; i <= last; ++i) {
+                points.emplace_back(double(i) / 1024, i == 0 || i == last ? 0.0 : shape(i) / 1024, 0.0);
+            }
+            auto expected = points;
+            simplifyRecursive(expected, 0, last, sqTolerance / (1024.0 * 1024.0));
+            detail::simplify(points, 0, last, sqTolerance / (1024.0 * 1024.0));
+
+            size_t kept = 0;
+            for (size_t i = 0; i <= last; ++i) {
+                ASSERT_EQ(points[i].z, expected[i].z) << "point " << i;
+                kept += points[i].z > 0;
+            }
+            ASSERT_GT(kept, 64u);
+        }
+    }
+}
+
 TEST(Clip, Polylines) {
     const detail::vt_line_string points1{ { 0, 0 },   { 50, 0 },  { 50, 10 }, { 20, 10 },
                                           { 20, 20 }, { 30, 20 }, { 30, 30 }, { 50, 30 },
@@ -106,6 +198,11 @@ TEST(Clip, Polylines) {
 
     ASSERT_EQ(expected1, clipped1);
     ASSERT_EQ(expected2, clipped2);
+
+    // slices are allocated at their final size, as they're kept by the tiles
+    for (const auto& slice : clipped1.get<detail::vt_multi_line_string>()) {
+        ASSERT_EQ(slice.capacity(), slice.size());
+    }
 }
 
 TEST(Clip, PolylinesLineMetrics) {
@@ -200,6 +297,91 @@ TEST(Clip, Points) {
     ASSERT_EQ(expected2, clipped2);
 }
 
+TEST(Clip, LongGeometries) {
+    // long enough for runs of points inside and outside the lines across several blocks
+    detail::vt_line_string line;
+    detail::vt_linear_ring ring;
+    for (int i = 0; i < 1000; ++i) {
+        line.emplace_back((i + 0.5) / 1000, i % 2);
+        ring.emplace_back(0.5 + 0.2 * std::cos(i * M_PI / 500), 0.5 + 0.2 * std::sin(i * M_PI / 500));
+    }
+    ring.push_back(ring.front());
+
+    const auto clipped = detail::clipper<0>{ 0.25, 0.75 }(line).get<detail::vt_line_string>();
+    ASSERT_EQ(clipped.size(), 502u);
+    ASSERT_EQ(clipped.front().x, 0.25);
+    ASSERT_EQ(clipped.back().x, 0.75);
+    for (size_t i = 1; i < clipped.size() - 1; ++i) {
+        ASSERT_EQ(clipped[i].x, line[249 + i].x);
+        ASSERT_EQ(clipped[i].y, line[249 + i].y);
+    }
+
+    const auto inside = detail::clipper<0>{ 0.25, 0.75 }(detail::vt_polygon{ ring });
+    ASSERT_EQ(inside, detail::vt_geometry{ detail::vt_polygon{ ring } });
+    const auto outside = detail::clipper<1>{ 0.75, 1 }(detail::vt_polygon{ ring });
+    ASSERT_TRUE(outside.get<detail::vt_polygon>().empty());
+}
+
+TEST(Clip, Quadrants) {
+    const auto features = detail::convert(
+        mapbox::geojson::parse(loadFile("test/fixtures/us-states.json")).get<feature_collection>(), 1e-9,
+        false);
+    mapbox::geometry::box<double> bbox{ { 2, 1 }, { -1, 0 } };
+    for (const auto& feature : features) {
+        bbox.min.x = std::min(bbox.min.x, feature.bbox.min.x);
+        bbox.min.y = std::min(bbox.min.y, feature.bbox.min.y);
+        bbox.max.x = std::max(bbox.max.x, feature.bbox.max.x);
+        bbox.max.y = std::max(bbox.max.y, feature.bbox.max.y);
+    }
+
+    // halves that overlap by a buffer, through the middle of the states
+    const double xs[] = { 0.15, 0.26, 0.24, 0.35 };
+    const double ys[] = { 0.33, 0.39, 0.37, 0.43 };
+    for (const bool lineMetrics : { false, true }) {
+        const auto quadrants = detail::clipQuadrants(features, xs[0], xs[1], xs[2], xs[3], ys[0], ys[1], ys[2],
+                                                     ys[3], bbox, lineMetrics);
+        for (size_t i = 0; i < 4; ++i) {
+            const auto column = detail::clip<0>(features, xs[(i & 1) * 2], xs[(i & 1) * 2 + 1], bbox.min.x,
+                                                bbox.max.x, lineMetrics);
+            const auto expected = detail::clip<1>(column, ys[(i >> 1) * 2], ys[(i >> 1) * 2 + 1], bbox.min.y,
+                                                  bbox.max.y, lineMetrics);
+            ASSERT_FALSE(expected.empty());
+            ASSERT_EQ(quadrants[i].size(), expected.size());
+            for (size_t j = 0; j < expected.size(); ++j) {
+                ASSERT_TRUE(*quadrants[i][j].geometry == *expected[j].geometry);
+                ASSERT_EQ(quadrants[i][j].id, expected[j].id);
+            }
+        }
+    }
+}
+
+TEST(Project, Latitudes) {
+    // the batch projection is within a thousandth of a unit of the scalar one at zoom 24 with an
+    // extent of 4096, over the latitudes it handles
+    std::vector<double> latitudes;
+    for (double lat = -detail::mercator_max_latitude; lat <= detail::mercator_max_latitude; lat += 0.001) {
+        latitudes.push_back(lat);
+    }
+    std::vector<double> y(latitudes.size());
+    detail::mercator_y(latitudes.data(), y.data(), latitudes.size());
+    const double unit = 1.0 / (4096.0 * (1 << 24));
+    for (std::size_t i = 0; i < latitudes.size(); ++i) {
+        ASSERT_NEAR(y[i], detail::mercator_y(latitudes[i]), unit / 1000);
+    }
+
+    // the others are projected one at a time
+    const mapbox::geometry::line_string<double> line{ { 0, 90 }, { 10, -90 }, { 20, 100 }, { 30, 85.2 }, { 40, 45 } };
+    const auto projected = detail::project{ 0 }(line);
+    ASSERT_EQ(projected.size(), line.size());
+    for (std::size_t i = 0; i < line.size(); ++i) {
+        ASSERT_EQ(projected[i].x, line[i].x / 360 + 0.5);
+        if (i < 4)
+            ASSERT_EQ(projected[i].y, detail::mercator_y(line[i].y));
+        else
+            ASSERT_NEAR(projected[i].y, detail::mercator_y(line[i].y), unit / 1000);
+    }
+}
+
 TEST(GetTile, USStates) {
     const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
     GeoJSONVT index{ geojson.get<mapbox::geojson::feature_collection>() };
@@ -235,6 +417,644 @@ TEST(GetTile, GenerateIds) {
     ASSERT_EQ(features == expected, true);
 }
 
+TEST(GetTile, Concurrent) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    struct TileCoordinate {
+        uint8_t z;
+        uint32_t x;
+        uint32_t y;
+    };
+
+    // every tile around z7-37-48 from z0 down to z12, so most requests need a drill-down
+    std::vector<TileCoordinate> tileCoordinates;
+    for (uint8_t z = 0; z <= 12; ++z) {
+        const uint32_t x0 = z < 7 ? 37u >> (7 - z) : 37u << (z - 7);
+        const uint32_t y0 = z < 7 ? 48u >> (7 - z) : 48u << (z - 7);
+        const uint32_t last = (1u << z) - 1;
+        for (uint32_t x = x0 > 2 ? x0 - 2 : 0; x <= std::min(x0 + 2, last); ++x) {
+            for (uint32_t y = y0 > 2 ? y0 - 2 : 0; y <= std::min(y0 + 2, last); ++y) {
+                tileCoordinates.push_back({ z, x, y });
+            }
+        }
+    }
+
+    Options options;
+    options.maxZoom = 12;
+
+    GeoJSONVT serial{ geojson, options };
+    std::vector<Tile> expected;
+    for (const auto& c : tileCoordinates) {
+        expected.push_back(serial.getTile(c.z, c.x, c.y));
+    }
+
+    GeoJSONVT index{ geojson, options };
+
+    const size_t numThreads = 16;
+    std::vector<std::vector<Tile>> actual(numThreads, std::vector<Tile>(tileCoordinates.size()));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&, t] {
+            // each thread requests all tiles in its own order
+            std::vector<size_t> order(tileCoordinates.size());
+            for (size_t i = 0; i < order.size(); ++i) {
+                order[i] = i;
+            }
+            std::shuffle(order.begin(), order.end(), std::mt19937(t));
+            for (const auto i : order) {
+                const auto& c = tileCoordinates[i];
+                actual[t][i] = index.getTile(c.z, c.x, c.y);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    ASSERT_EQ(serial.total, index.total);
+    ASSERT_EQ(serial.stats, index.stats);
+    for (size_t t = 0; t < numThreads; ++t) {
+        for (size_t i = 0; i < tileCoordinates.size(); ++i) {
+            ASSERT_EQ(expected[i] == actual[t][i], true);
+            ASSERT_EQ(expected[i].features.size(), actual[t][i].features.size());
+            for (size_t f = 0; f < expected[i].features.size(); ++f) {
+                ASSERT_TRUE(expected[i].features[f].geometry == actual[t][i].features[f].geometry);
+            }
+        }
+    }
+}
+
+TEST(GetTile, CacheBudget) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    Options options;
+    options.maxZoom = 12;
+    GeoJSONVT unbounded{ geojson, options };
+
+    options.maxCacheBytes = 20000;
+    GeoJSONVT bounded{ geojson, options };
+    const auto indexed = bounded.total;
+
+    // drill down twice, so the second pass regenerates tiles evicted during the first one
+    for (int pass = 0; pass < 2; ++pass) {
+        for (uint8_t z = 6; z <= 12; ++z) {
+            const uint32_t x0 = 37u << (z - 6) >> 1;
+            const uint32_t y0 = 48u << (z - 6) >> 1;
+            for (uint32_t x = x0; x < x0 + 3; ++x) {
+                for (uint32_t y = y0; y < y0 + 3; ++y) {
+                    const Tile expected = unbounded.getTile(z, x, y);
+                    const Tile actual = bounded.getTile(z, x, y);
+                    ASSERT_EQ(expected == actual, true);
+                }
+            }
+        }
+    }
+
+    ASSERT_LT(bounded.total, unbounded.total);
+    ASSERT_GE(bounded.total, indexed);
+}
+
+TEST(GetTile, CacheBudgetThreadExit) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    Options options;
+    options.maxZoom = 12;
+    options.maxCacheBytes = 1;
+    GeoJSONVT index{ geojson, options };
+
+    // the tile a thread got last is kept while the thread runs, but not after it exits
+    const uint64_t id = toID(10, 37 * 8 + 3, 48 * 8 + 3);
+    std::thread([&] { index.getTile(10, 37 * 8 + 3, 48 * 8 + 3); }).join();
+    ASSERT_NE(index.getInternalTiles().find(id), index.getInternalTiles().end());
+
+    index.getTile(10, 37 * 8 + 7, 48 * 8 + 7);
+    ASSERT_EQ(index.getInternalTiles().find(id), index.getInternalTiles().end());
+}
+
+TEST(GetTile, Batch) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    Options options;
+    options.maxZoom = 12;
+    GeoJSONVT single{ geojson, options };
+
+    for (const uint64_t budget : { uint64_t(0), uint64_t(20000) }) {
+        options.maxCacheBytes = budget;
+        GeoJSONVT batch{ geojson, options };
+
+        for (uint8_t z = 6; z <= 12; ++z) {
+            const uint32_t x0 = 37u << (z - 6) >> 1;
+            const uint32_t y0 = 48u << (z - 6) >> 1;
+            const auto tiles = batch.getTiles(z, x0, y0, x0 + 3, y0 + 2);
+            ASSERT_EQ(tiles.size(), 12u);
+            for (uint32_t i = 0; i < tiles.size(); ++i) {
+                const Tile expected = single.getTile(z, x0 + i % 4, y0 + i / 4);
+                ASSERT_EQ(expected == *tiles[i], true);
+            }
+        }
+    }
+
+    GeoJSONVT index{ geojson };
+    ASSERT_THROW(index.getTiles(2, 3, 0, 4, 0), std::runtime_error);
+    ASSERT_THROW(index.getTiles(2, 1, 0, 0, 0), std::runtime_error);
+}
+
+TEST(GetTile, Prewarm) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    Options options;
+    options.maxZoom = 10;
+    GeoJSONVT expected{ geojson, options };
+
+    options.threads = 3;
+    GeoJSONVT index{ geojson, options };
+    index.prewarm(6, 10, { { -107, 25 }, { -93, 37 } }).get();
+
+    // the tiles over Texas are all there, so requesting them doesn't generate anything
+    const auto total = index.total;
+    for (uint8_t z = 6; z <= 10; ++z) {
+        const uint32_t x = 13u << (z - 5) >> 1;
+        const uint32_t y = 26u << (z - 5) >> 1;
+        ASSERT_EQ(expected.getTile(z, x, y) == index.getTile(z, x, y), true);
+        ASSERT_EQ(expected.getTile(z, x + 1, y + 1) == index.getTile(z, x + 1, y + 1), true);
+    }
+    ASSERT_EQ(total, index.total);
+
+    ASSERT_THROW(index.prewarm(8, 7), std::runtime_error);
+    ASSERT_THROW(index.prewarm(0, 11), std::runtime_error);
+}
+
+TEST(GetTile, SharedGeometry) {
+    const auto geojson =
+        mapbox::geojson::parse(R"({"type":"Point","coordinates":[-77.03,38.9]})");
+
+    // with a cache budget, tiles on the drill-down path keep their source features
+    Options options;
+    options.maxCacheBytes = 1 << 20;
+    GeoJSONVT index{ geojson, options };
+    index.getTile(3, 2, 3);
+
+    // the point is never clipped, so every tile refers to the same geometry
+    const auto& tiles = index.getInternalTiles();
+    const auto& root = tiles.at(toID(0, 0, 0)).source_features;
+    const auto& drilled = tiles.at(toID(3, 2, 3)).source_features;
+    ASSERT_EQ(root.size(), 1u);
+    ASSERT_EQ(drilled.size(), 1u);
+    ASSERT_EQ(root[0].geometry, drilled[0].geometry);
+}
+
+TEST(GetTile, MemoryUsage) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    Options options;
+    options.maxCacheBytes = 1 << 30;
+    GeoJSONVT index{ geojson, options };
+    index.getTile(8, 52, 104);
+
+    // tiles on the drill-down path share their source geometry, which is only counted once
+    const auto usage = index.getMemoryUsage();
+    ASSERT_EQ(usage.size(), index.stats.size());
+    std::size_t total = 0;
+    for (const auto& pair : usage) {
+        total += pair.second.total();
+    }
+    std::size_t tiles = 0;
+    for (const auto& pair : index.getInternalTiles()) {
+        const auto& tile = pair.second;
+        tiles += index.getMemoryUsage(tile.z, tile.x, tile.y).total();
+    }
+    ASSERT_GT(total, 0u);
+    ASSERT_LT(total, tiles);
+
+    // the root tile hasn't been requested, so its features aren't transformed yet
+    const auto pending = index.getMemoryUsage(0, 0, 0);
+    ASSERT_GT(pending.sourceFeatures, 0u);
+    ASSERT_GT(pending.tileFeatures, 0u);
+    ASSERT_EQ(pending.properties, 0u);
+
+    // flat features point at the source property maps, so nothing is copied until the build
+    index.getFlatTile(0, 0, 0);
+    const auto flat = index.getMemoryUsage(0, 0, 0);
+    ASSERT_EQ(flat.sourceFeatures, pending.sourceFeatures);
+    ASSERT_GT(flat.tileFeatures, 0u);
+    ASSERT_EQ(flat.properties, 0u);
+
+    index.getTile(0, 0, 0);
+    const auto root = index.getMemoryUsage(0, 0, 0);
+    ASSERT_EQ(root.sourceFeatures, pending.sourceFeatures);
+    ASSERT_GT(root.tileFeatures, flat.tileFeatures);
+    ASSERT_GT(root.properties, 0u);
+
+    const auto drilled = index.getMemoryUsage(8, 52, 104);
+    ASSERT_EQ(drilled.total(), detail::estimateSize(index.getInternalTiles().at(toID(8, 52, 104))));
+    ASSERT_EQ(index.getMemoryUsage(8, 0, 0).total(), 0u);
+
+    // a tile that's split further lets go of its source, so even before it's requested it holds
+    // its output rather than the full-resolution geometry
+    Options splitOptions;
+    splitOptions.indexMaxPoints = 200;
+    GeoJSONVT split{ geojson, splitOptions };
+    const auto splitRoot = split.getMemoryUsage(0, 0, 0);
+    ASSERT_EQ(splitRoot.sourceFeatures, 0u);
+    ASSERT_GT(splitRoot.tileFeatures, 0u);
+    ASSERT_LT(splitRoot.tileFeatures,
+              split.getInternalTiles().at(toID(0, 0, 0)).numPoints() * sizeof(detail::vt_point));
+
+    // built without the flat features being requested, the tile only holds its geometry once
+    split.getTile(0, 0, 0);
+    const auto built = split.getMemoryUsage(0, 0, 0);
+    split.getFlatTile(0, 0, 0);
+    ASSERT_LT(built.tileFeatures, split.getMemoryUsage(0, 0, 0).tileFeatures);
+}
+
+TEST(GetTile, CompactSource) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    // every 97th vertex of the states, so that the tiles drilled down to have borders in them
+    std::vector<std::pair<double, double>> vertices;
+    std::size_t n = 0;
+    for (const auto& feature : geojson.get<mapbox::geojson::feature_collection>()) {
+        mapbox::geometry::for_each_point(feature.geometry, [&](const auto& p) {
+            if (n++ % 97 == 0)
+                vertices.emplace_back(p.x / 360 + 0.5, detail::mercator_y(p.y));
+        });
+    }
+
+    for (const uint8_t maxZoom : { uint8_t(12), uint8_t(20) }) {
+        Options options;
+        options.maxZoom = maxZoom;
+        GeoJSONVT plain{ geojson, options };
+        const auto total = plain.total;
+        const auto sourceFeatures = plain.getMemoryUsage(0, 0, 0).sourceFeatures;
+
+        options.compactSource = true;
+        for (const uint64_t budget : { uint64_t(0), uint64_t(20000) }) {
+            options.maxCacheBytes = budget;
+            GeoJSONVT compact{ geojson, options };
+            ASSERT_EQ(compact.total, total);
+            // features are only packed where they're precise enough at maxZoom, which the root
+            // tile isn't with maxZoom 20
+            if (maxZoom == 12)
+                ASSERT_LT(compact.getMemoryUsage(0, 0, 0).sourceFeatures, sourceFeatures / 2);
+            else
+                ASSERT_EQ(compact.getMemoryUsage(0, 0, 0).sourceFeatures, sourceFeatures);
+
+            // down to maxZoom, the same features are drilled down to, with the same points kept
+            // by simplification; a few points round the other way
+            std::size_t points = 0, rounded = 0;
+            for (uint8_t z = 0; z <= maxZoom; ++z) {
+                for (const auto& vertex : vertices) {
+                    const auto x = uint32_t(vertex.first * (1u << z));
+                    const auto y = uint32_t(vertex.second * (1u << z));
+                    const Tile expected = plain.getTile(z, x, y);
+                    const Tile actual = compact.getTile(z, x, y);
+                    ASSERT_EQ(expected == actual, true);
+                    for (std::size_t f = 0; f < expected.features.size(); ++f) {
+                        std::vector<mapbox::geometry::point<int16_t>> a, b;
+                        mapbox::geometry::for_each_point(expected.features[f].geometry,
+                                                         [&](const auto& p) { a.push_back(p); });
+                        mapbox::geometry::for_each_point(actual.features[f].geometry,
+                                                         [&](const auto& p) { b.push_back(p); });
+                        ASSERT_EQ(a.size(), b.size());
+                        for (std::size_t i = 0; i < a.size(); ++i) {
+                            ASSERT_LE(std::abs(a[i].x - b[i].x), 1);
+                            ASSERT_LE(std::abs(a[i].y - b[i].y), 1);
+                            rounded += a[i] != b[i];
+                        }
+                        points += a.size();
+                    }
+                }
+            }
+            ASSERT_GT(points, 100000u);
+            ASSERT_LT(rounded * 1000, points);
+        }
+    }
+}
+
+namespace {
+
+// reads the fields of a protocol buffer message one by one
+struct PbfReader {
+    explicit PbfReader(std::string data_) : data(std::move(data_)) {}
+
+    std::string data;
+    std::size_t i = 0;
+    uint32_t field = 0;
+    uint32_t type = 0;
+
+    bool next() {
+        if (i >= data.size())
+            return false;
+        const auto key = varint();
+        field = static_cast<uint32_t>(key >> 3);
+        type = static_cast<uint32_t>(key & 7);
+        return true;
+    }
+    uint64_t varint() {
+        uint64_t value = 0;
+        for (unsigned shift = 0;; shift += 7) {
+            const auto byte = static_cast<uint8_t>(data.at(i++));
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+    }
+    std::string bytes() {
+        const auto size = varint();
+        EXPECT_LE(i + size, data.size());
+        auto result = data.substr(i, size);
+        i += size;
+        return result;
+    }
+    std::vector<uint32_t> packed() {
+        PbfReader values{ bytes() };
+        std::vector<uint32_t> result;
+        while (values.i < values.data.size()) {
+            result.push_back(static_cast<uint32_t>(values.varint()));
+        }
+        return result;
+    }
+};
+
+struct DecodedFeature {
+    uint64_t type = 0;
+    std::vector<uint32_t> tags;
+    // points, lines or rings, with rings closed by repeating their first point
+    std::vector<std::vector<mapbox::geometry::point<int16_t>>> parts;
+};
+
+struct DecodedLayer {
+    std::string name;
+    std::vector<DecodedFeature> features;
+    std::vector<std::string> keys;
+    std::vector<std::string> values;
+    uint64_t extent = 0;
+    uint64_t version = 0;
+};
+
+DecodedFeature decodeFeature(const std::string& data) {
+    DecodedFeature feature;
+    PbfReader message{ data };
+    while (message.next()) {
+        if (message.field == 2) {
+            feature.tags = message.packed();
+        } else if (message.field == 3) {
+            feature.type = message.varint();
+        } else if (message.field == 4) {
+            // move to, line to and close path commands, with zigzag-encoded deltas from a cursor
+            const auto commands = message.packed();
+            int32_t x = 0, y = 0;
+            for (std::size_t c = 0; c < commands.size();) {
+                const uint32_t id = commands[c] & 7;
+                const uint32_t count = commands[c++] >> 3;
+                if (id == 7) {
+                    EXPECT_EQ(count, 1u);
+                    auto& ring = feature.parts.back();
+                    ring.push_back(ring.front());
+                    continue;
+                }
+                EXPECT_TRUE(id == 1 || id == 2);
+                for (uint32_t k = 0; k < count; ++k) {
+                    x += static_cast<int32_t>(commands.at(c) >> 1) ^ -static_cast<int32_t>(commands.at(c) & 1);
+                    y += static_cast<int32_t>(commands.at(c + 1) >> 1) ^ -static_cast<int32_t>(commands.at(c + 1) & 1);
+                    c += 2;
+                    if (id == 1)
+                        feature.parts.emplace_back();
+                    feature.parts.back().emplace_back(static_cast<int16_t>(x), static_cast<int16_t>(y));
+                }
+            }
+        } else {
+            ADD_FAILURE() << "unexpected feature field " << message.field;
+            return feature;
+        }
+    }
+    return feature;
+}
+
+// the single layer of an encoded tile
+DecodedLayer decodeTile(const std::string& encoded) {
+    DecodedLayer layer;
+    PbfReader tile{ encoded };
+    EXPECT_TRUE(tile.next());
+    EXPECT_EQ(tile.field, 3u);
+    EXPECT_EQ(tile.type, 2u);
+    PbfReader message{ tile.bytes() };
+    EXPECT_FALSE(tile.next());
+
+    while (message.next()) {
+        switch (message.field) {
+        case 1: layer.name = message.bytes(); break;
+        case 2: layer.features.push_back(decodeFeature(message.bytes())); break;
+        case 3: layer.keys.push_back(message.bytes()); break;
+        case 4: layer.values.push_back(message.bytes()); break;
+        case 5: layer.extent = message.varint(); break;
+        case 15: layer.version = message.varint(); break;
+        default: ADD_FAILURE() << "unexpected layer field " << message.field; return layer;
+        }
+    }
+    return layer;
+}
+
+// the string in an encoded Value message
+std::string decodeString(const std::string& value) {
+    PbfReader message{ value };
+    EXPECT_TRUE(message.next());
+    EXPECT_EQ(message.field, 1u);
+    return message.bytes();
+}
+
+template <class Points>
+std::vector<mapbox::geometry::point<int16_t>> toPoints(const Points& points) {
+    return { points.begin(), points.end() };
+}
+
+} // namespace
+
+TEST(GetTile, EncodedTile) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    GeoJSONVT unbuilt{ geojson };
+    GeoJSONVT built{ geojson };
+    const auto& tile = built.getTile(7, 37, 48);
+    const std::string encoded = unbuilt.getEncodedTile(7, 37, 48, "states");
+    // built tiles are encoded the same way, though their properties may come in another order
+    ASSERT_EQ(encoded.size(), built.getEncodedTile(7, 37, 48, "states").size());
+    ASSERT_EQ(unbuilt.getEncodedTile(7, 0, 0, "states"), "");
+
+    const auto states = decodeTile(encoded);
+    ASSERT_EQ(states.name, "states");
+    ASSERT_EQ(states.features.size(), tile.features.size());
+    ASSERT_EQ(states.keys.size(), 2u);
+    ASSERT_EQ(states.extent, 4096u);
+    ASSERT_EQ(states.version, 2u);
+    for (const auto& feature : states.features) {
+        ASSERT_EQ(feature.type, 3u);
+        ASSERT_FALSE(feature.parts.empty());
+    }
+
+    // a polygon with a hole and two lines, two of which have the same properties; the exterior
+    // ring is clockwise in longitude and latitude, so both rings keep their winding in the tile
+    const auto shapes = mapbox::geojson::parse(R"({"type": "FeatureCollection", "features": [
+        {"type": "Feature", "properties": {"kind": "park", "name": "a"}, "geometry": {"type": "Polygon",
+            "coordinates": [[[-90, -45], [-90, 45], [90, 45], [90, -45], [-90, -45]],
+                            [[-30, -20], [30, -20], [30, 20], [-30, 20], [-30, -20]]]}},
+        {"type": "Feature", "properties": {"kind": "park", "name": "b"}, "geometry": {"type": "LineString",
+            "coordinates": [[-120, -60], [0, 10], [120, -60]]}},
+        {"type": "Feature", "properties": {"kind": "park", "name": "a"}, "geometry": {"type": "LineString",
+            "coordinates": [[-150, 70], [150, 70]]}}]})");
+    GeoJSONVT index{ shapes };
+    const auto decoded = decodeTile(index.getEncodedTile(0, 0, 0, "shapes"));
+    const auto& expected = index.getTile(0, 0, 0);
+    ASSERT_EQ(decoded.name, "shapes");
+    ASSERT_EQ(decoded.features.size(), 3u);
+    ASSERT_EQ(expected.features.size(), 3u);
+
+    const auto& polygon = expected.features[0].geometry.get<mapbox::geometry::polygon<int16_t>>();
+    ASSERT_EQ(decoded.features[0].type, 3u);
+    ASSERT_EQ(decoded.features[0].parts.size(), 2u);
+    ASSERT_EQ(decoded.features[0].parts[0], toPoints(polygon[0]));
+    ASSERT_EQ(decoded.features[0].parts[1], toPoints(polygon[1]));
+    for (std::size_t f = 1; f < 3; ++f) {
+        const auto& line = expected.features[f].geometry.get<mapbox::geometry::line_string<int16_t>>();
+        ASSERT_EQ(decoded.features[f].type, 2u);
+        ASSERT_EQ(decoded.features[f].parts.size(), 1u);
+        ASSERT_EQ(decoded.features[f].parts[0], toPoints(line));
+    }
+
+    // each key and value is written once, and the tags point back at the feature's properties
+    ASSERT_EQ(std::set<std::string>(decoded.keys.begin(), decoded.keys.end()),
+              (std::set<std::string>{ "kind", "name" }));
+    ASSERT_EQ(decoded.keys.size(), 2u);
+    std::vector<std::string> values;
+    for (const auto& value : decoded.values) {
+        values.push_back(decodeString(value));
+    }
+    ASSERT_EQ(std::set<std::string>(values.begin(), values.end()),
+              (std::set<std::string>{ "park", "a", "b" }));
+    ASSERT_EQ(values.size(), 3u);
+    ASSERT_EQ(decoded.features[0].tags, decoded.features[2].tags);
+    for (std::size_t f = 0; f < 3; ++f) {
+        const auto& tags = decoded.features[f].tags;
+        ASSERT_EQ(tags.size(), 4u);
+        for (std::size_t t = 0; t < tags.size(); t += 2) {
+            const auto& property = expected.features[f].properties.at(decoded.keys.at(tags[t]));
+            ASSERT_EQ(property.get<std::string>(), values.at(tags[t + 1]));
+        }
+    }
+}
+
+TEST(GetTile, FlatTile) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+    GeoJSONVT index{ geojson };
+
+    const uint32_t coords[][3] = { { 0, 0, 0 }, { 7, 37, 48 }, { 9, 148, 192 } };
+    for (const auto& c : coords) {
+        const auto& flat = index.getFlatTile(c[0], c[1], c[2]);
+        const auto& tile = index.getTile(c[0], c[1], c[2]);
+        ASSERT_EQ(flat.size(), tile.features.size());
+        ASSERT_EQ(flat.num_points, tile.num_points);
+        ASSERT_EQ(flat.num_simplified, tile.num_simplified);
+
+        // the points of each feature, in the same order as in the nested geometry
+        std::size_t p = 0;
+        for (std::size_t i = 0; i < flat.size(); ++i) {
+            const auto& feature = tile.features[i];
+            ASSERT_EQ(flat.types[i], FlatTile::Polygon);
+            ASSERT_EQ(flat.ids[i], feature.id);
+            ASSERT_EQ(*flat.properties[flat.property_indices[i]], feature.properties);
+            mapbox::geometry::for_each_point(feature.geometry, [&](const auto& point) {
+                EXPECT_TRUE(flat.points[p++] == point);
+            });
+            ASSERT_EQ(p, flat.ring_offsets[flat.part_offsets[flat.feature_offsets[i + 1]]]);
+        }
+        ASSERT_EQ(p, flat.points.size());
+
+        // built first, the tile lets go of its flat geometry and flattens it again on request
+        GeoJSONVT built{ geojson };
+        built.getTile(c[0], c[1], c[2]);
+        const auto& flattened = built.getFlatTile(c[0], c[1], c[2]);
+        ASSERT_TRUE(flattened.points == flat.points);
+        ASSERT_EQ(flattened.ring_offsets, flat.ring_offsets);
+        ASSERT_EQ(flattened.part_offsets, flat.part_offsets);
+        ASSERT_EQ(flattened.feature_offsets, flat.feature_offsets);
+        ASSERT_EQ(flattened.types, flat.types);
+        ASSERT_EQ(flattened.ids, flat.ids);
+        ASSERT_EQ(flattened.num_simplified, flat.num_simplified);
+    }
+    ASSERT_EQ(index.getFlatTile(7, 0, 0).size(), 0u);
+}
+
+TEST(GetTile, SharedProperties) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    Options options;
+    options.sharedProperties = true;
+    GeoJSONVT shared{ geojson, options };
+    GeoJSONVT copied{ geojson };
+
+    const auto& tile = shared.getTile(7, 37, 48);
+    const auto& expected = copied.getTile(7, 37, 48);
+    ASSERT_TRUE(expected.properties.empty());
+    ASSERT_EQ(tile.features.size(), expected.features.size());
+    ASSERT_EQ(tile.properties.size(), tile.features.size());
+    for (std::size_t i = 0; i < tile.features.size(); ++i) {
+        ASSERT_TRUE(tile.features[i].geometry == expected.features[i].geometry);
+        ASSERT_TRUE(tile.features[i].properties.empty());
+        ASSERT_EQ(*tile.properties[i], expected.features[i].properties);
+    }
+
+    // the parent tile refers to the same property maps
+    const auto& parent = shared.getTile(6, 18, 24);
+    for (const auto& props : tile.properties) {
+        ASSERT_NE(std::find(parent.properties.begin(), parent.properties.end(), props), parent.properties.end());
+    }
+}
+
+TEST(TileStore, InsertFindErase) {
+    detail::tile_store store;
+    const detail::vt_features features;
+    std::vector<const detail::InternalTile*> stored;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        const auto result = store.emplace(toID(10, i, i / 3), { features, 10, i, i / 3, 4096, 0, false });
+        ASSERT_TRUE(result.second);
+        stored.push_back(&result.first->second);
+    }
+    ASSERT_FALSE(store.emplace(toID(10, 0, 0), { features, 10, 0, 0, 4096, 0, false }).second);
+    ASSERT_TRUE(store.hasZoom(10));
+    ASSERT_FALSE(store.hasZoom(9));
+
+    // erase every other tile; the others stay where they are
+    for (uint32_t i = 0; i < 1000; i += 2) {
+        ASSERT_EQ(store.erase(toID(10, i, i / 3)), 1u);
+    }
+    ASSERT_EQ(store.erase(toID(10, 0, 0)), 0u);
+    ASSERT_EQ(store.size(), 500u);
+    for (uint32_t i = 0; i < 1000; ++i) {
+        const auto it = store.find(toID(10, i, i / 3));
+        if (i % 2) {
+            ASSERT_TRUE(it != store.end());
+            ASSERT_EQ(&it->second, stored[i]);
+            ASSERT_EQ(it->second.x, i);
+        } else {
+            ASSERT_TRUE(it == store.end());
+        }
+    }
+
+    std::size_t count = 0;
+    for (const auto& pair : store) {
+        ASSERT_EQ(pair.first, toID(pair.second.z, pair.second.x, pair.second.y));
+        ++count;
+    }
+    ASSERT_EQ(count, 500u);
+
+    for (uint32_t i = 1; i < 1000; i += 2) {
+        store.erase(toID(10, i, i / 3));
+    }
+    ASSERT_TRUE(store.empty());
+    ASSERT_FALSE(store.hasZoom(10));
+    ASSERT_TRUE(store.begin() == store.end());
+}
+
 TEST(GetTile, AntimeridianTriangle) {
     const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/dateline-triangle.json"));
 
@@ -417,6 +1237,273 @@ TEST(GenTiles, NoObjectGeoJSON) {
     }
 }
 
+TEST(GenTiles, ParallelBuild) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+
+    Options options;
+    options.maxZoom = 14;
+    options.indexMaxZoom = 7;
+    options.indexMaxPoints = 200;
+
+    GeoJSONVT serial{ geojson, options };
+    options.threads = 4;
+    GeoJSONVT parallel{ geojson, options };
+
+    ASSERT_EQ(serial.total, parallel.total);
+    ASSERT_EQ(serial.stats, parallel.stats);
+    for (const auto& pair : serial.getInternalTiles()) {
+        const auto it = parallel.getInternalTiles().find(pair.first);
+        ASSERT_TRUE(it != parallel.getInternalTiles().end());
+        ASSERT_EQ(pair.second.source_features.size(), it->second.source_features.size());
+
+        const auto& expected = pair.second.getTile();
+        const auto& actual = it->second.getTile();
+        ASSERT_EQ(expected == actual, true);
+        for (size_t i = 0; i < expected.features.size(); ++i) {
+            ASSERT_TRUE(expected.features[i].geometry == actual.features[i].geometry);
+        }
+    }
+}
+
+TEST(GenTiles, ParallelConvert) {
+    const auto states = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"))
+                            .get<feature_collection>();
+    // enough features for several blocks
+    feature_collection features;
+    for (int i = 0; i < 10; ++i) {
+        features.insert(features.end(), states.begin(), states.end());
+    }
+
+    const auto serial = detail::convert(features, 1e-9, true, 5);
+    const auto parallel = detail::convert(features, 1e-9, true, 5, nullptr, 4);
+    ASSERT_EQ(serial.size(), features.size());
+    ASSERT_EQ(parallel.size(), features.size());
+    for (size_t i = 0; i < features.size(); ++i) {
+        ASSERT_EQ(parallel[i].id, mapbox::feature::identifier(uint64_t(5 + i)));
+        ASSERT_TRUE(*parallel[i].geometry == *serial[i].geometry);
+        ASSERT_EQ(*parallel[i].properties, *serial[i].properties);
+    }
+}
+
+TEST(GenTiles, Update) {
+    const auto states = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"))
+                            .get<feature_collection>();
+
+    Options options;
+    options.maxZoom = 10;
+    options.indexMaxPoints = 200;
+    options.updatable = true;
+    GeoJSONVT index{ states, options };
+
+    struct TileCoordinate {
+        uint8_t z;
+        uint32_t x;
+        uint32_t y;
+    };
+
+    // tiles around Texas, drilled into before the update
+    std::vector<TileCoordinate> tileCoordinates;
+    for (uint8_t z = 0; z <= 10; ++z) {
+        const uint32_t z2 = 1u << z;
+        for (uint32_t x = z2 * 40 / 256; x < std::min(z2, z2 * 40 / 256 + 6); ++x) {
+            for (uint32_t y = z2 * 90 / 256; y < std::min(z2, z2 * 90 / 256 + 6); ++y) {
+                tileCoordinates.push_back({ z, x, y });
+            }
+        }
+    }
+    for (const auto& c : tileCoordinates) {
+        index.getTile(c.z, c.x, c.y);
+    }
+    const Tile* washington = &index.getTile(5, 5, 11);
+
+    // move Texas, remove Alabama and add a point
+    feature_collection changed;
+    feature_collection expected;
+    for (const auto& feature : states) {
+        if (feature.id == mapbox::feature::identifier{ std::string("48") }) {
+            auto moved = feature;
+            mapbox::geometry::for_each_point(moved.geometry, [](auto& point) {
+                point.x += 3;
+                point.y -= 1;
+            });
+            changed.push_back(moved);
+        } else if (feature.id != mapbox::feature::identifier{ std::string("01") }) {
+            expected.push_back(feature);
+        }
+    }
+    changed.emplace_back(mapbox::geometry::point<double>(-90, 40), mapbox::feature::property_map{},
+                         mapbox::feature::identifier{ std::string("new") });
+    expected.insert(expected.end(), changed.begin(), changed.end());
+
+    index.update(changed, { mapbox::feature::identifier{ std::string("01") } });
+
+    options.updatable = false;
+    GeoJSONVT rebuilt{ expected, options };
+    for (const auto& c : tileCoordinates) {
+        ASSERT_EQ(rebuilt.getTile(c.z, c.x, c.y) == index.getTile(c.z, c.x, c.y), true);
+    }
+
+    // a tile far from the changes isn't generated again
+    ASSERT_EQ(washington, &index.getTile(5, 5, 11));
+
+    GeoJSONVT fixed{ states };
+    ASSERT_THROW(fixed.update(changed), std::runtime_error);
+}
+
+TEST(GenTiles, Builder) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/dateline.json"));
+    const auto features = geojson.get<mapbox::geojson::feature_collection>();
+
+    Options options;
+    options.lineMetrics = true;
+    options.generateId = true;
+    GeoJSONVT index{ features, options };
+
+    GeoJSONVT::Builder builder{ options };
+    builder.add(features.begin(), features.begin() + 1);
+    for (auto it = features.begin() + 1; it != features.end(); ++it) {
+        builder.add(*it);
+    }
+    const auto built = builder.build();
+
+    ASSERT_EQ(index.total, built->total);
+    ASSERT_EQ(index.stats, built->stats);
+    for (const auto& pair : index.getInternalTiles()) {
+        const auto& tile = pair.second;
+        ASSERT_EQ(tile.getTile() == built->getTile(tile.z, tile.x, tile.y), true);
+    }
+    ASSERT_EQ(index.getTile(8, 0, 81) == built->getTile(8, 0, 81), true);
+}
+
+TEST(GenTiles, ParseText) {
+    Options options;
+    options.indexMaxPoints = 200;
+    options.generateId = true;
+    options.lineMetrics = true;
+    for (const auto* file : { "test/fixtures/us-states.json", "test/fixtures/dateline.json",
+                              "test/fixtures/feature.json", "test/fixtures/single-geom.json",
+                              "test/fixtures/collection.json" }) {
+        const auto json = loadFile(file);
+        GeoJSONVT index{ mapbox::geojson::parse(json), options };
+        const auto parsed = mapbox::geojsonvt::parse(json, options);
+
+        ASSERT_EQ(index.total, parsed->total);
+        for (const auto& pair : index.getInternalTiles()) {
+            const auto& tile = pair.second;
+            ASSERT_EQ(tile.getTile() == parsed->getTile(tile.z, tile.x, tile.y), true);
+        }
+    }
+
+    // members can come in any order, and ones that aren't GeoJSON are skipped
+    const auto reordered = mapbox::geojsonvt::parse(
+        R"({"features":[{"properties":{"name":"a","tags":[1,{"b":-2}]},"geometry":{"coordinates":)"
+        R"([-77.03,38.9],"type":"Point"},"id":7,"type":"Feature"}],"bbox":[0,0,1,1],"type":"FeatureCollection"})");
+    const auto& features = reordered->getTile(0, 0, 0).features;
+    ASSERT_EQ(features.size(), 1);
+    ASSERT_EQ(features[0].id, mapbox::feature::identifier(uint64_t(7)));
+    ASSERT_EQ(features[0].properties.at("name"), mapbox::feature::value(std::string("a")));
+    ASSERT_EQ(features[0].properties.count("tags"), 1);
+
+    try {
+        mapbox::geojsonvt::parse("{\"type\": \"Pologon\"}");
+        FAIL() << "Expected exception";
+    } catch (const std::runtime_error& ex) {
+        ASSERT_STREQ("Pologon geometry must have a coordinates property", ex.what());
+    }
+    ASSERT_THROW(mapbox::geojsonvt::parse("42"), std::runtime_error);
+    ASSERT_THROW(mapbox::geojsonvt::parse(R"({"type":"LineString","coordinates":[[1]]})"), std::runtime_error);
+    ASSERT_THROW(mapbox::geojsonvt::parse(R"({"type":"Feature",)"), std::runtime_error);
+}
+
+TEST(GenTiles, PropertyFilter) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/us-states.json"));
+    const auto keys = [&](const Options& options) {
+        std::set<std::string> result;
+        GeoJSONVT index{ geojson, options };
+        for (const auto& feature : index.getTile(7, 37, 48).features) {
+            for (const auto& property : feature.properties) {
+                result.insert(property.first);
+            }
+        }
+        return result;
+    };
+
+    Options options;
+    ASSERT_EQ(keys(options), (std::set<std::string>{ "name", "density" }));
+
+    options.propertyKeys = { "name", "population" };
+    ASSERT_EQ(keys(options), (std::set<std::string>{ "name" }));
+
+    options.propertyKeys = {};
+    options.numericProperties = true;
+    ASSERT_EQ(keys(options), (std::set<std::string>{ "density" }));
+
+    options.numericProperties = false;
+    options.propertyFilter = [](const std::string&, const mapbox::feature::value& value) {
+        return value.is<std::string>() && value.get<std::string>() == "Delaware";
+    };
+    GeoJSONVT index{ geojson, options };
+    const auto& features = index.getTile(7, 37, 48).features;
+    ASSERT_EQ(std::count_if(features.begin(), features.end(), [](const auto& feature) {
+                  return !feature.properties.empty();
+              }),
+              1);
+}
+
+TEST(GenTiles, Snapshot) {
+    const auto geojson = mapbox::geojson::parse(loadFile("test/fixtures/dateline.json"));
+
+    Options options;
+    options.maxZoom = 8;
+    options.indexMaxZoom = 2;
+    options.lineMetrics = true;
+    GeoJSONVT index{ geojson, options };
+    const auto& built = index.getTile(1, 0, 0);
+
+    const std::string path = "test/snapshot.bin";
+    index.save(path);
+    // saving doesn't keep the flat features of tiles that only had the built ones, or the others
+    for (const auto& pair : index.getInternalTiles()) {
+        const auto& tile = pair.second;
+        ASSERT_FALSE(tile.isFlatKept());
+        ASSERT_EQ(tile.isBuilt(), tile.z == 1 && tile.x == 0 && tile.y == 0);
+    }
+    const auto loaded = GeoJSONVT::load(path);
+
+    // the source features are left in the file until they're drilled down from
+    std::size_t sources = 0;
+    for (const auto& pair : loaded->getInternalTiles()) {
+        const auto& tile = pair.second;
+        ASSERT_EQ(tile.hasSource(), index.getInternalTiles().at(pair.first).hasSource());
+        sources += tile.hasSource();
+        ASSERT_EQ(loaded->getMemoryUsage(tile.z, tile.x, tile.y).sourceFeatures, 0u);
+    }
+    ASSERT_GT(sources, 0u);
+
+    ASSERT_EQ(index.total, loaded->total);
+    ASSERT_EQ(index.stats, loaded->stats);
+    ASSERT_EQ(built == loaded->getTile(1, 0, 0), true);
+    for (const auto& pair : index.getInternalTiles()) {
+        const auto& tile = pair.second;
+        ASSERT_EQ(tile.getTile() == loaded->getTile(tile.z, tile.x, tile.y), true);
+    }
+
+    // a loaded index is saved with the source features it hasn't read yet
+    loaded->save(path);
+    const auto reloaded = GeoJSONVT::load(path);
+    std::remove(path.c_str());
+
+    // tiles below the index are drilled down into from the loaded source features
+    ASSERT_EQ(index.getTile(8, 0, 81) == loaded->getTile(8, 0, 81), true);
+    ASSERT_EQ(index.getTile(8, 255, 81) == loaded->getTile(8, 255, 81), true);
+    ASSERT_EQ(index.getTile(8, 0, 81) == reloaded->getTile(8, 0, 81), true);
+    ASSERT_EQ(index.getTile(8, 255, 81) == reloaded->getTile(8, 255, 81), true);
+
+    std::ofstream("test/snapshot.bin") << "not a snapshot";
+    ASSERT_THROW(GeoJSONVT::load(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
 INSTANTIATE_TEST_CASE_P(
     Full,
     TileTest,
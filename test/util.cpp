@@ -123,6 +123,10 @@ bool operator==(const mapbox::geojsonvt::Tile& a, const mapbox::geojsonvt::Tile&
     EXPECT_EQ(a.features == b.features, true);
     EXPECT_EQ(a.num_points, b.num_points);
     EXPECT_EQ(a.num_simplified, b.num_simplified);
+    EXPECT_EQ(a.properties.size(), b.properties.size());
+    for (std::size_t i = 0; i < a.properties.size() && i < b.properties.size(); ++i) {
+        EXPECT_EQ(*a.properties[i] == *b.properties[i], true);
+    }
     return true;
 }
 